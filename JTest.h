@@ -9,11 +9,64 @@
 #ifndef INC_JTEST_HPP
 #define INC_JTEST_HPP
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
 #include <functional>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#define JTEST_MALLINFO
+#include <malloc.h>
+#endif
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define JTEST_POSIX
+#include <csetjmp>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// JTEST_ASYNC needs C++20 coroutines and epoll
+#if __cplusplus >= 202002L && defined(__linux__) && __has_include(<coroutine>)
+#define JTEST_COROUTINES
+#include <coroutine>
+#include <optional>
+#include <sys/epoll.h>
+#endif
 
 // simple token transformation functions
 #define STRINGIFY(x) #x
@@ -49,17 +102,48 @@
 #define PASSEDSTATUS CONSOLEGREEN "[PASSED]" CONSOLEDEFAULT
 #define FAILEDSTATUS CONSOLERED "[FAILED]" CONSOLEDEFAULT
 #define FLAWEDSTATUS CONSOLEYELLOW "[FLAWED]" CONSOLEDEFAULT
+#define FLAKYSTATUS CONSOLEYELLOW "[FLAKY]" CONSOLEDEFAULT
+#define GROWINGSTATUS CONSOLERED "[GROWING]" CONSOLEDEFAULT
+#define BENCHSTATUS CONSOLEGREEN "[BENCH]" CONSOLEDEFAULT
+#define WARNINGSTATUS CONSOLEYELLOW "[WARNING]" CONSOLEDEFAULT
+#define CRASHEDSTATUS CONSOLERED "[CRASHED]" CONSOLEDEFAULT
+#define CANCELLEDSTATUS CONSOLEYELLOW "[CANCELLED]" CONSOLEDEFAULT
 #define COMPLETEF CONSOLERED "[RESULT]\tSome tests failed." CONSOLEDEFAULT
 #define COMPLETEP CONSOLEGREEN "[RESULT]\tAll tests passed!" CONSOLEDEFAULT
 #define TERSEP                                                                 \
   CONSOLEGREEN "[REPORT]\tAll expectations were met!" CONSOLEDEFAULT
 
+// how long a JLOAD keeps issuing operations, every file that includes JTest.h
+// has to see the same value
+#ifndef JLOAD_DURATION_MS
+#define JLOAD_DURATION_MS 1000
+#endif
+
+// a JLOAD spins instead of sleeping for the last JLOAD_SPIN_US microseconds
+// before an operation is due
+#ifndef JLOAD_SPIN_US
+#define JLOAD_SPIN_US 200
+#endif
+
+// JTEST_LOG keeps the last JLOG_ENTRIES messages of every thread of a test,
+// every file that includes JTest.h has to see the same value
+#ifndef JLOG_ENTRIES
+#define JLOG_ENTRIES 64
+#endif
+
+// a JBENCH grows its iteration count until one measurement takes at least this
+// long, each pass aims 40% past it from the last timing, at most 10 times more
+#ifndef JBENCH_MIN_TIME_MS
+#define JBENCH_MIN_TIME_MS 250
+#endif
+
 // the following expect_... will error outside of the context of a JTEST(){}
 // block
 
 // will add a fail if inp1 != inp2
 #define EXPECT_EQ(inp1, inp2)                                                  \
   do {                                                                         \
+    t.poll();                                                                  \
     if ((inp1) != (inp2)) {                                                    \
       t.incr();                                                                \
     }                                                                          \
@@ -68,6 +152,7 @@
 // will add a fail if !(inp1) == true
 #define EXPECT_TRUE(inp1)                                                      \
   do {                                                                         \
+    t.poll();                                                                  \
     if (!(inp1)) {                                                             \
       t.incr();                                                                \
     }                                                                          \
@@ -76,6 +161,7 @@
 // will add a fail if inp1 == true
 #define EXPECT_FALSE(inp1)                                                     \
   do {                                                                         \
+    t.poll();                                                                  \
     if ((inp1)) {                                                              \
       t.incr();                                                                \
     }                                                                          \
@@ -84,6 +170,7 @@
 // will fail if inp1 throws an exception
 #define EXPECT_LIFE(ACTION)                                                    \
   do {                                                                         \
+    t.poll();                                                                  \
     try {                                                                      \
       ACTION;                                                                  \
     } catch (...) {                                                            \
@@ -94,6 +181,7 @@
 // will fail if inp1 does not throw an exception
 #define EXPECT_DEATH(ACTION)                                                   \
   do {                                                                         \
+    t.poll();                                                                  \
     try {                                                                      \
       ACTION;                                                                  \
       t.incr();                                                                \
@@ -105,6 +193,7 @@
 // exception is not of type ERR_TYPE
 #define EXPECT_ERRORTYPE(ERR_TYPE, ACTION)                                     \
   do {                                                                         \
+    t.poll();                                                                  \
     try {                                                                      \
       ACTION;                                                                  \
       t.incr();                                                                \
@@ -114,10 +203,64 @@
     }                                                                          \
   } while (false)
 
+// will add a fail if the concurrent _history can't be explained by running its
+// operations one at a time on a copy of _model, the shortest failing prefix
+// of the history is printed with the test result
+#define EXPECT_LINEARIZABLE(_history, _model)                                  \
+  do {                                                                         \
+    t.poll();                                                                  \
+    std::ostringstream _why;                                                   \
+    if (!JTest::linearizable((_history), (_model), &_why)) {                   \
+      t.incr();                                                                \
+      t.note(_why.str());                                                      \
+    }                                                                          \
+  } while (false)
+
+// will add a fail if ACTION, run in a child process, doesn't end the way the
+// predicate after it expects: JTest::exitedWith(code), JTest::killedBy(signal)
+// or any callable taking the wait status. A glob pattern (* and ?) after the
+// predicate also has to match everything the child wrote to stderr
+#define EXPECT_EXIT(ACTION, ...)                                               \
+  do {                                                                         \
+    t.poll();                                                                  \
+    std::ostringstream _why;                                                   \
+    if (!JTest::internal::exits([&] { ACTION; }, _why, __VA_ARGS__)) {         \
+      t.incr();                                                                \
+      t.note(_why.str());                                                      \
+    }                                                                          \
+  } while (false)
+
+// keeps a message for the test running on the calling thread, printed under
+// the result only if the test doesn't pass. The arguments are copied and only
+// formatted (with operator<<) then: JTEST_LOG("retry ", attempt, " of ", n);
+#define JTEST_LOG(...) JTest::internal::log(__FILE__, __LINE__, __VA_ARGS__)
+
+// will add a fail if ACTION, run in a child process, doesn't abort()
+#define EXPECT_ABORT(ACTION) EXPECT_EXIT(ACTION, JTest::killedBy(SIGABRT))
+
 // jtest environment creator
 #define JTESTENV(_envname)                                                     \
   class _envname : public JTest::internal::_JTESTENV_base
 
+// every test of the environment claims the resources, e.g.
+// JTESTENV_RESOURCES(SERVER, JTest::exclusive("port 8080"));
+// inline, so the environment can live in a header several files include
+#define JTESTENV_RESOURCES(_envname, ...)                                      \
+  inline bool CONCAT2(_envname, env, resources) =                              \
+      JTest::internal::declare(TOSTRING(_envname), {__VA_ARGS__})
+
+// jtest environment whose tests never run alongside each other with --jobs
+#define JTESTENV_SERIAL(_envname)                                              \
+  JTESTENV_RESOURCES(_envname, JTest::exclusive("JTESTENV " #_envname));       \
+  JTESTENV(_envname)
+
+// the test claims the resources on top of those of its environment, e.g.
+// JTEST_RESOURCES(CACHE, reload, JTest::shared("config dir", 4));
+#define JTEST_RESOURCES(_envname, _testname, ...)                              \
+  inline bool CONCAT2(_envname, _testname, resources) =                        \
+      JTest::internal::declare(TOSTRING(_envname) "." TOSTRING(_testname),     \
+                               {__VA_ARGS__})
+
 #define SETUP                                                                  \
 public:                                                                        \
   virtual void setup() override
@@ -134,7 +277,9 @@ public:                                                                        \
     void _testfuncname(JTest::internal::test &t);                              \
     void _envfuncname(JTest::internal::test &t) {                              \
       setup();                                                                 \
+      t.setupDone();                                                           \
       _testfuncname(t);                                                        \
+      t.bodyDone();                                                            \
       teardown();                                                              \
     }                                                                          \
   };                                                                           \
@@ -154,139 +299,5046 @@ public:                                                                        \
               CONCAT2(_envname, _testname, dummy),                             \
               CONCAT2(_envname, _testname, _bool))
 
+// stress test creator, SETUP builds one environment and _threads threads run
+// the body _iterations times each, released together from a spin barrier
+#define JTESTSTRESSEXPAND(_envname, _testname, _threads, _iterations,          \
+                          _testclassname, _testfuncname, _envfuncname,         \
+                          _dummyname, _boolname)                               \
+  class _testclassname : public _envname {                                     \
+  public:                                                                      \
+    _testclassname() = default;                                                \
+    void _testfuncname(JTest::internal::test &t);                              \
+    void _envfuncname(JTest::internal::test &t) {                              \
+      setup();                                                                 \
+      t.setupDone();                                                           \
+      JTest::internal::stress(                                                 \
+          t, (_threads), (_iterations),                                        \
+          [this](JTest::internal::test &t) { _testfuncname(t); });             \
+      t.bodyDone();                                                            \
+      teardown();                                                              \
+    }                                                                          \
+  };                                                                           \
+  void _dummyname(JTest::internal::test &t) {                                  \
+    _testclassname suite{};                                                    \
+    suite._envfuncname(t);                                                     \
+  }                                                                            \
+  bool _boolname = JTest::TestRegister::registerTest(                          \
+      TOSTRING(_envname),                                                      \
+      JTest::internal::test{TOSTRING(_testname), _dummyname});                 \
+  void _testclassname::_testfuncname(JTest::internal::test &t)
+
+#define JTEST_STRESS(_envname, _testname, _threads, _iterations)               \
+  JTESTSTRESSEXPAND(_envname, _testname, _threads, _iterations,                \
+                    CONCAT2(_envname, _testname, stress),                      \
+                    CONCAT2(_envname, _testname, stresstest),                  \
+                    CONCAT2(_envname, _testname, stressenv),                   \
+                    CONCAT2(_envname, _testname, stressdummy),                 \
+                    CONCAT2(_envname, _testname, stressbool))
+
+// exploration test creator, the body is run over and over with a fresh
+// environment while a deterministic scheduler tries out the interleavings of
+// the threads it creates with JTest::explore::thread
+#define JTESTEXPLOREEXPAND(_envname, _testname, _testclassname, _testfuncname, \
+                           _dummyname, _boolname)                              \
+  class _testclassname : public _envname {                                     \
+  public:                                                                      \
+    _testclassname() = default;                                                \
+    void _testfuncname(JTest::internal::test &t);                              \
+  };                                                                           \
+  void _dummyname(JTest::internal::test &t) {                                  \
+    JTest::internal::explore(t, &_testclassname::_testfuncname);               \
+  }                                                                            \
+  bool _boolname = JTest::TestRegister::registerTest(                          \
+      TOSTRING(_envname),                                                      \
+      JTest::internal::test{TOSTRING(_testname), _dummyname});                 \
+  void _testclassname::_testfuncname(JTest::internal::test &t)
+
+#define JTEST_EXPLORE(_envname, _testname)                                     \
+  JTESTEXPLOREEXPAND(_envname, _testname,                                      \
+                     CONCAT2(_envname, _testname, explore),                    \
+                     CONCAT2(_envname, _testname, exploretest),                \
+                     CONCAT2(_envname, _testname, exploredummy),               \
+                     CONCAT2(_envname, _testname, explorebool))
+
+#ifdef JTEST_COROUTINES
+// async test creator, the body is a coroutine returning JTest::task<> that can
+// co_await timers and file descriptors, all async tests share one event loop
+// thread and run before the other tests. The environment lives until the body
+// finishes.
+#define JTESTASYNCEXPAND(_envname, _testname, _testclassname, _testfuncname,   \
+                         _dummyname, _boolname)                                \
+  class _testclassname : public _envname {                                     \
+  public:                                                                      \
+    _testclassname() = default;                                                \
+    JTest::task<> _testfuncname(JTest::internal::test &t);                     \
+  };                                                                           \
+  void _dummyname(JTest::internal::test &t) {                                  \
+    auto suite = std::make_shared<_testclassname>();                           \
+    suite->setup();                                                            \
+    JTest::internal::eventloop::instance().start(                              \
+        t, suite->_testfuncname(t), [suite] { suite->teardown(); });           \
+  }                                                                            \
+  bool _boolname = JTest::TestRegister::registerTest(                          \
+      TOSTRING(_envname),                                                      \
+      JTest::internal::test{TOSTRING(_testname), _dummyname, true});           \
+  JTest::task<> _testclassname::_testfuncname(JTest::internal::test &t)
+
+#define JTEST_ASYNC(_envname, _testname)                                       \
+  JTESTASYNCEXPAND(_envname, _testname, CONCAT2(_envname, _testname, async),   \
+                   CONCAT2(_envname, _testname, asynctest),                    \
+                   CONCAT2(_envname, _testname, asyncdummy),                   \
+                   CONCAT2(_envname, _testname, asyncbool))
+#endif
+
+// marks a spot where a race could happen, under JTEST_STRESS with
+// --stress-yield it randomly yields or spins there to widen the race window,
+// under JTEST_EXPLORE it is a scheduling point
+#define JTEST_YIELD_POINT() JTest::internal::yieldPoint()
+
+// jload creator, _rate operations per second run against one environment
+// built by SETUP, every operation runs the body once
+#define JLOADEXPAND(_envname, _loadname, _rate, _loadclassname, _loadfuncname, \
+                    _envfuncname, _dummyname, _boolname)                       \
+  class _loadclassname : public _envname {                                     \
+  public:                                                                      \
+    _loadclassname() = default;                                                \
+    void _loadfuncname(JTest::internal::test &t);                              \
+    void _envfuncname(JTest::internal::bench &b) {                             \
+      setup();                                                                 \
+      JTest::internal::openloop(                                               \
+          b, (_rate), [this](JTest::internal::test &t) { _loadfuncname(t); }); \
+      teardown();                                                              \
+    }                                                                          \
+  };                                                                           \
+  void _dummyname(JTest::internal::bench &b) {                                 \
+    _loadclassname suite{};                                                    \
+    suite._envfuncname(b);                                                     \
+  }                                                                            \
+  bool _boolname = JTest::TestRegister::registerBench(                         \
+      TOSTRING(_envname),                                                      \
+      JTest::internal::bench{TOSTRING(_loadname), _dummyname});                \
+  void _loadclassname::_loadfuncname(JTest::internal::test &t)
+
+#define JLOAD(_envname, _loadname, _rate)                                      \
+  JLOADEXPAND(_envname, _loadname, _rate, CONCAT2(_envname, _loadname, load),  \
+              CONCAT2(_envname, _loadname, loadop),                            \
+              CONCAT2(_envname, _loadname, loadenv),                           \
+              CONCAT2(_envname, _loadname, loaddummy),                         \
+              CONCAT2(_envname, _loadname, loadbool))
+
+// jbench creator, SETUP builds the environment once per row of the report
+// (input size and thread count), the calibration passes and the timed one all
+// run on it, on every thread count in the configured range at once
+#define JBENCHEXPAND(_envname, _benchname, _config, _benchclassname,           \
+                     _benchfuncname, _loopname, _dummyname, _boolname)         \
+  class _benchclassname : public _envname {                                    \
+  public:                                                                      \
+    _benchclassname() = default;                                               \
+    void _benchfuncname(JTest::internal::test &t);                             \
+    void _loopname(JTest::internal::test &t, std::size_t iterations) {         \
+      for (std::size_t i = 0; i < iterations; ++i) {                           \
+        _benchfuncname(t);                                                     \
+      }                                                                        \
+    }                                                                          \
+  };                                                                           \
+  void _dummyname(JTest::internal::bench &b) {                                 \
+    JTest::internal::timedloop(b, _config, &_benchclassname::_loopname);       \
+  }                                                                            \
+  bool _boolname = JTest::TestRegister::registerBench(                         \
+      TOSTRING(_envname),                                                      \
+      JTest::internal::bench{TOSTRING(_benchname), _dummyname});               \
+  void _benchclassname::_benchfuncname(JTest::internal::test &t)
+
+#define JBENCHNAMES(_envname, _benchname, _config)                             \
+  JBENCHEXPAND(_envname, _benchname, _config,                                  \
+               CONCAT2(_envname, _benchname, bench),                           \
+               CONCAT2(_envname, _benchname, benchop),                         \
+               CONCAT2(_envname, _benchname, benchloop),                       \
+               CONCAT2(_envname, _benchname, benchdummy),                      \
+               CONCAT2(_envname, _benchname, benchbool))
+
+#define JBENCH(_envname, _benchname)                                           \
+  JBENCHNAMES(_envname, _benchname, (JTest::internal::benchconfig{1, 1}))
+
+// runs the body on _minthreads, twice as many, ... up to _maxthreads threads
+#define JBENCH_THREADS(_envname, _benchname, _minthreads, _maxthreads)         \
+  JBENCHNAMES(_envname, _benchname,                                            \
+              (JTest::internal::benchconfig{_minthreads, _maxthreads}))
+
+// runs the body for input sizes _minsize, twice as large, ... up to _maxsize,
+// the size is available as benchSize() in SETUP and in the body, the timings
+// are fitted against common complexity classes
+#define JBENCH_SIZES(_envname, _benchname, _minsize, _maxsize)                 \
+  JBENCHNAMES(_envname, _benchname,                                            \
+              (JTest::internal::benchconfig{1, 1, _minsize, _maxsize}))
+
+// like JBENCH_SIZES, but fails when the best fit grows faster than _complexity
+#define JBENCH_COMPLEXITY(_envname, _benchname, _minsize, _maxsize,            \
+                          _complexity)                                         \
+  JBENCHNAMES(_envname, _benchname,                                            \
+              (JTest::internal::benchconfig{1, 1, _minsize, _maxsize,          \
+                                            JTest::complexity::_complexity}))
+
+// exception handling is optional, code built with -fno-exceptions can use
+// everything except EXPECT_LIFE, EXPECT_DEATH and EXPECT_ERRORTYPE
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define JTEST_EXCEPTIONS
+#define JTEST_TRY try
+#define JTEST_CATCH(...) catch (__VA_ARGS__)
+#define JTEST_THROW(...) throw __VA_ARGS__
+#define JTEST_RETHROW throw
+#else
+#define JTEST_TRY if (true)
+#define JTEST_CATCH(...) else if (false)
+#define JTEST_THROW(...) std::abort()
+#define JTEST_RETHROW
+#endif
+
 // JTest begin
 
 namespace JTest {
+class virtualclock;
 namespace internal {
 struct test;
-}
+struct bench;
+} // namespace internal
 
 using testfunc = std::function<void(internal::test &)>;
+using benchfunc = std::function<void(internal::bench &)>;
 using std::list;
 using std::map;
 using std::string;
+using std::vector;
+
+// complexity classes a JBENCH_SIZES sweep is fitted against
+enum class complexity { o1, ologn, on, onlogn, on2 };
+
+// something tests share, like a port or a directory, named in
+// JTEST_RESOURCES. With --jobs, tests that claim it don't overlap.
+struct resource {
+  string name;
+  bool exclusive;
+  // how many shared users at once, 0 for any number
+  std::uint32_t limit;
+};
+
+// no other test that claims the resource runs at the same time
+inline resource exclusive(string name) { return {std::move(name), true, 0}; }
+
+// runs next to other shared users of the resource, at most limit of them at
+// once (0 for no limit), but never next to an exclusive one
+inline resource shared(string name, std::uint32_t limit = 0) {
+  return {std::move(name), false, limit};
+}
 
 namespace internal {
+// the resources of an environment (by its name) or of one test (ENV.name)
+inline map<string, vector<resource>> &declared() {
+  static map<string, vector<resource>> resources;
+  return resources;
+}
+
+// a key is declared by one macro, declaring it again replaces the same list
+inline bool declare(string &&key, vector<resource> &&resources) {
+  declared()[key] = std::move(resources);
+  return true;
+}
+
 class _JTESTENV_base {
 protected:
   // prevent construction of objects of this type
   _JTESTENV_base() = default;
   _JTESTENV_base(void *){};
 
+  // the input size of the running JBENCH_SIZES measurement, 0 everywhere else
+  std::size_t benchSize() const { return _benchsize; }
+
 public:
   virtual void setup() {}
   virtual void teardown() {}
+
+  std::size_t _benchsize = 0;
 };
 
-struct test {
-  test(string &&name, testfunc func) : t_name(name), t_func(func) {}
+// one JTEST_LOG message, its arguments stay unformatted until it is printed
+struct logentry {
+  // orders the messages of all threads of a test
+  std::uint64_t sequence;
+  const char *file;
+  int line;
+  void (*print)(const logentry &, std::ostream &);
+  alignas(std::max_align_t) unsigned char data[64];
+};
 
-  void operator()() { t_func(*this); }
+// the last JLOG_ENTRIES messages of one thread, older ones are overwritten
+struct logring {
+  logentry entries[JLOG_ENTRIES];
+  std::uint64_t written = 0;
+};
 
-  inline void incr() { ++failures; }
+// where the characters of a text argument were copied to in logentry::data
+struct logtext {
+  std::uint8_t offset;
+  std::uint8_t size;
+};
 
-  inline void prettyPrint() {
-    std::cout << "\t" << CONSOLEBLUE << t_name << CONSOLEDEFAULT << ": ";
+// an argument is copied as is when that's cheap and safe. Text, a char pointer,
+// a char array or a string, may live in a buffer that is gone by the time the
+// log is printed, its characters are copied behind the other arguments.
+template <class T> struct loggable {
+  using value = typename std::decay<T>::type;
+  using pointee =
+      typename std::remove_cv<typename std::remove_pointer<value>::type>::type;
+  static constexpr bool text =
+      (std::is_pointer<value>::value &&
+       (std::is_same<pointee, char>::value ||
+        std::is_same<pointee, signed char>::value ||
+        std::is_same<pointee, unsigned char>::value)) ||
+      std::is_same<value, string>::value ||
+      std::is_same<value, std::string_view>::value;
+  static constexpr bool lazy =
+      text || std::is_trivially_copyable<value>::value;
+  using stored = typename std::conditional<text, logtext, value>::type;
+};
+
+inline std::string_view textOf(const char *text) {
+  return text ? text : "(null)";
+}
+inline std::string_view textOf(const signed char *text) {
+  return textOf(reinterpret_cast<const char *>(text));
+}
+inline std::string_view textOf(const unsigned char *text) {
+  return textOf(reinterpret_cast<const char *>(text));
+}
+inline std::string_view textOf(std::string_view text) { return text; }
+
+template <class T> inline std::size_t textSize(const T &arg) {
+  if constexpr (loggable<T>::text) {
+    return textOf(arg).size();
+  } else {
+    return 0;
   }
+}
 
-  unsigned short failures = 0;
-  string t_name;
-  testfunc t_func;
-};
+// the argument as it is stored, text is copied to e.data from used on
+template <class T>
+inline typename loggable<T>::stored keep(logentry &e, std::size_t &used,
+                                         T &&arg) {
+  if constexpr (loggable<T>::text) {
+    const std::string_view text = textOf(arg);
+    std::memcpy(e.data + used, text.data(), text.size());
+    const logtext kept{static_cast<std::uint8_t>(used),
+                       static_cast<std::uint8_t>(text.size())};
+    used += text.size();
+    return kept;
+  } else {
+    return std::forward<T>(arg);
+  }
+}
 
-}; // namespace internal
+template <class T>
+inline void show(const logentry &, std::ostream &out, const T &value) {
+  out << value;
+}
 
-class TestRegister {
-public:
-  static bool registerTest(string &&envname, internal::test &&t) {
-    auto &_tests = getInstance()._tests;
-    auto _testiter = _tests.find(envname);
-    if (_testiter == _tests.end()) {
-      _tests[envname] = list{t};
-    } else {
-      (*_testiter).second.push_back(t);
+inline void show(const logentry &e, std::ostream &out, const logtext &text) {
+  out << std::string_view(reinterpret_cast<const char *>(e.data) + text.offset,
+                          text.size);
+}
+
+template <class PACKED>
+inline void printPacked(const logentry &e, std::ostream &out) {
+  std::apply([&](const auto &...values) { (show(e, out, values), ...); },
+             *reinterpret_cast<const PACKED *>(e.data));
+}
+
+inline void printText(const logentry &e, std::ostream &out) {
+  out << reinterpret_cast<const char *>(e.data);
+}
+
+// stores the arguments in e, formats them right away only if they don't fit
+// or can't be kept
+template <class... ARGS> inline void pack(logentry &e, ARGS &&...args) {
+  using packed = std::tuple<typename loggable<ARGS>::stored...>;
+  if constexpr (sizeof(packed) <= sizeof(e.data) &&
+                alignof(packed) <= alignof(std::max_align_t) &&
+                (loggable<ARGS>::lazy && ...)) {
+    std::size_t used = sizeof(packed);
+    if (used + (textSize(args) + ... + 0) <= sizeof(e.data)) {
+      new (e.data) packed(keep(e, used, std::forward<ARGS>(args))...);
+      e.print = &printPacked<packed>;
+      return;
     }
-    return true;
   }
+  std::ostringstream formatted;
+  (formatted << ... << args);
+  const string text = formatted.str();
+  const std::size_t kept = std::min(text.size(), sizeof(e.data) - 1);
+  std::copy(text.begin(), text.begin() + kept, e.data);
+  e.data[kept] = '\0';
+  e.print = &printText;
+}
 
-  static void _dump() {
-    auto &_tests = getInstance()._tests;
-    for (auto &p : _tests) {
-      std::cout << "ENV:\t" << p.first << std::endl;
-      for (auto &t : p.second) {
-        std::cout << "TEST:\t" << t.t_name << t.failures << std::endl;
-      }
+// set under --fail-fast once a test failed, it points into shared memory
+// while worker processes run
+inline std::atomic<int> *&cancellation() {
+  static std::atomic<int> local{0};
+  static std::atomic<int> *flag = &local;
+  return flag;
+}
+
+// thrown by EXPECT_* into a test that --fail-fast cancelled
+struct cancelledtest {};
+
+// unmet expectations and JTEST_LOG messages of one thread, only that thread
+// ever writes to it
+struct tally {
+  std::atomic<unsigned> count{0};
+  std::unique_ptr<logring> log;
+};
+
+// what a run of a test used of the machine
+struct usage {
+  // nanoseconds
+  double wall;
+  // the peak resident set in bytes, 0 when it isn't known
+  std::uint64_t peak;
+  // page faults served without and with i/o
+  std::int64_t minorfaults;
+  std::int64_t majorfaults;
+  // the thread waited, or was preempted
+  std::int64_t voluntary;
+  std::int64_t involuntary;
+};
+
+// when a run of a test and its phases ended, in nanoseconds of the steady
+// clock, which all processes share, and the worker that ran it
+struct span {
+  std::int64_t start;
+  // the end of SETUP and of the body, 0 if the test doesn't have them
+  std::int64_t setup;
+  std::int64_t body;
+  std::int64_t end;
+  std::int32_t worker;
+};
+
+struct test {
+  test(string &&name, testfunc func, bool async = false)
+      : t_name(name), t_func(func), t_async(async) {}
+
+  // the tallies belong to one run of the original, a copy starts empty
+  test(const test &other)
+      : failures(other.failures), t_name(other.t_name), t_func(other.t_func),
+        t_notes(other.t_notes), t_async(other.t_async) {}
+
+  void operator()() {
+    begin();
+    JTEST_TRY {
+      t_func(*this);
+    } JTEST_CATCH(...) {
+      end();
+      JTEST_RETHROW;
     }
+    end();
   }
 
-  static int runAllTests() {
-    auto &_tests = getInstance()._tests;
-    bool completefail = false;
-    for (auto &p_envtestlist : _tests) {
-      std::cout << CONSOLEMAGENTA << "STARTED:\t{ " << p_envtestlist.first
-                << " }" << CONSOLEDEFAULT << std::endl;
+  // resets the counts and makes this the test of the calling thread
+  void begin() {
+    t_thread = std::this_thread::get_id();
+    failures = 0;
+    t_notes.clear();
+    t_logs.clear();
+    t_log.clear();
+    t_tallies.clear();
+    t_id = nextId();
+    t_previous = current();
+    current() = this;
+  }
 
-      int failingTests = p_envtestlist.second.size();
+  // merges the per-thread counts into failures, every thread that recorded
+  // expectations has to be joined by now
+  void end() {
+    std::lock_guard<std::mutex> guard{t_lock};
+    for (auto &tl : t_tallies) {
+      failures += tl.count.load(std::memory_order_relaxed);
+      if (tl.log) {
+        t_logs.push_back(std::move(tl.log));
+      }
+    }
+    t_tallies.clear();
+    current() = t_previous;
+  }
 
-      for (auto &t : p_envtestlist.second) {
-        std::cout << RUNNINGSTATUS << std::endl;
+  // safe to call from any thread, every thread counts into its own tally so
+  // only the first expectation of a thread in a run takes a lock
+  inline void incr() {
+    tally &mine = own();
+    mine.count.store(mine.count.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+  }
 
-        bool flawed = false;
+  template <class... ARGS>
+  void log(const char *file, int line, ARGS &&...args) {
+    tally &mine = own();
+    if (!mine.log) {
+      mine.log.reset(new logring());
+    }
+    logentry &e = mine.log->entries[mine.log->written++ % JLOG_ENTRIES];
+    e.sequence = logSequence().fetch_add(1, std::memory_order_relaxed);
+    e.file = file;
+    e.line = line;
+    pack(e, std::forward<ARGS>(args)...);
+  }
 
-        try {
-          t();
-        } catch (...) {
-          flawed = true;
+  // formats the kept JTEST_LOG messages into t_log if the test didn't pass,
+  // drops them either way
+  void keepLog() {
+    if ((failures || t_flawed || t_crashed) && !t_logs.empty()) {
+      vector<const logentry *> kept;
+      bool dropped = false;
+      for (auto &ring : t_logs) {
+        const std::uint64_t first =
+            ring->written > JLOG_ENTRIES ? ring->written - JLOG_ENTRIES : 0;
+        dropped = dropped || first > 0;
+        for (std::uint64_t i = first; i < ring->written; ++i) {
+          kept.push_back(&ring->entries[i % JLOG_ENTRIES]);
         }
+      }
+      std::sort(kept.begin(), kept.end(),
+                [](const logentry *a, const logentry *b) {
+                  return a->sequence < b->sequence;
+                });
+      std::ostringstream out;
+      if (dropped) {
+        out << "(older messages were overwritten)\n";
+      }
+      for (const logentry *e : kept) {
+        const char *file = std::strrchr(e->file, '/');
+        out << (file ? file + 1 : e->file) << ":" << e->line << ": ";
+        e->print(*e, out);
+        out << "\n";
+      }
+      t_log = out.str();
+    }
+    t_logs.clear();
+  }
 
-        std::cout << CONSOLECLEARLASTLINE;
+  // the JTEST macros mark the phases for --trace
+  void setupDone() { t_span.setup = stamp(); }
+  void bodyDone() { t_span.body = stamp(); }
 
-        if (!flawed && !t.failures) {
-          --failingTests;
-#ifdef TERSE
-          continue;
+  static std::int64_t stamp() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  // every EXPECT_* checks whether --fail-fast cancelled the run and then stops
+  // the test, but only on the thread that runs its body, threads the test
+  // started have to poll JTest::cancelled() themselves
+  inline void poll() {
+#ifdef JTEST_EXCEPTIONS
+    if (cancellation()->load(std::memory_order_relaxed) && !t_async &&
+        t_thread == std::this_thread::get_id()) {
+      throw cancelledtest{};
+    }
 #endif
-          std::cout << PASSEDSTATUS;
-          t.prettyPrint();
-          std::cout << "all expectations were met!" << std::endl;
-        } else if (flawed) {
-          std::cout << FLAWEDSTATUS;
-          t.prettyPrint();
-          std::cout << "an exception was thrown and not caught" << std::endl;
-          completefail = true;
-        } else {
-          std::cout << FAILEDSTATUS;
-          t.prettyPrint();
-          std::cout << t.failures << " unexpected event(s)" << std::endl;
-          completefail = true;
-        }
+  }
 
+  // an explanation printed under the result when the test doesn't pass
+  void note(const string &message) {
+    std::lock_guard<std::mutex> guard{t_lock};
+    t_notes.push_back(message);
+  }
+
+  inline void prettyPrint() {
+    std::cout << "\t" << CONSOLEBLUE << t_name << CONSOLEDEFAULT << ": ";
+  }
+
+  inline void printNotes() {
+    for (auto &n : t_notes) {
+      std::istringstream lines(n);
+      string line;
+      while (std::getline(lines, line)) {
+        std::cout << "\t\t" << line << std::endl;
       }
-#ifdef TERSE
-      if (!failingTests) {
-        std::cout << TERSEP << std::endl;
-      }
-#endif
-      std::cout << std::endl;
     }
+  }
 
-    std::cout << (completefail ? COMPLETEF : COMPLETEP) << std::endl;
-    return completefail;
+  inline void printLog() {
+    std::istringstream lines(t_log);
+    string line;
+    while (std::getline(lines, line)) {
+      std::cout << "\t\t> " << line << std::endl;
+    }
+    t_log.clear();
   }
 
-private:
-  TestRegister() = default;
-  TestRegister(void *){};
+  inline void printOutput() {
+    std::istringstream lines(t_output);
+    string line;
+    while (std::getline(lines, line)) {
+      std::cout << "\t\t| " << line << std::endl;
+    }
+    t_output.clear();
+  }
 
-  static TestRegister &getInstance() {
-    static TestRegister t{};
-    return t;
+  // the test running on the calling thread, JTest::thread carries it over
+  // to the threads a test creates
+  static test *&current() {
+    thread_local test *running = nullptr;
+    return running;
   }
 
-  map<string, list<internal::test>> _tests;
+  static std::uint64_t nextId() {
+    static std::atomic<std::uint64_t> id{0};
+    return ++id;
+  }
+
+  static std::atomic<std::uint64_t> &logSequence() {
+    static std::atomic<std::uint64_t> sequence{0};
+    return sequence;
+  }
+
+  unsigned failures = 0;
+  string t_name;
+  testfunc t_func;
+  list<string> t_notes;
+  // JTEST_ASYNC tests only start in t_func, they all finish together on the
+  // event loop before the other tests run
+  bool t_async = false;
+  bool t_flawed = false;
+  // the signal the test crashed with
+  int t_crashed = 0;
+  // the outcome is already known when the runner gets to the test
+  bool t_done = false;
+  // stopped by --fail-fast while it ran
+  bool t_cancelled = false;
+  // not run because of --fail-fast
+  bool t_skipped = false;
+  // what the test wrote while its output was captured, kept if it failed
+  string t_output;
+  // the formatted JTEST_LOG messages of a test that failed
+  string t_log;
+  usage t_usage{};
+  span t_span{};
+  // the virtual clock of the running environment, if it has one
+  virtualclock *t_clock = nullptr;
+
+private:
+  // the tally of the calling thread in this run of the test
+  tally &own() {
+    thread_local std::uint64_t cachedid = 0;
+    thread_local tally *cached = nullptr;
+    if (cachedid != t_id) {
+      std::lock_guard<std::mutex> guard{t_lock};
+      t_tallies.emplace_back();
+      cached = &t_tallies.back();
+      cachedid = t_id;
+    }
+    return *cached;
+  }
+
+  std::uint64_t t_id = nextId();
+  std::thread::id t_thread;
+  std::mutex t_lock;
+  list<tally> t_tallies;
+  list<std::unique_ptr<logring>> t_logs;
+  test *t_previous = nullptr;
 };
 
-inline int RunAllTests() { return TestRegister::runAllTests(); };
+// JTEST_LOG outside of a test does nothing
+template <class... ARGS>
+inline void log(const char *file, int line, ARGS &&...args) {
+  if (test *t = test::current()) {
+    t->log(file, line, std::forward<ARGS>(args)...);
+  }
+}
+
+// first line of a (sysfs) file, empty if it can't be read
+inline string readLine(const string &path) {
+  std::ifstream in(path);
+  string line;
+  std::getline(in, line);
+  return line;
+}
+
+// parses cpu lists like "0-3,6", the format of --benchmark-cpus and sysfs
+inline vector<int> parseCpuList(const string &list) {
+  vector<int> cpus;
+  std::istringstream in(list);
+  string part;
+  while (std::getline(in, part, ',')) {
+    const auto dash = part.find('-');
+    const int first = std::atoi(part.substr(0, dash).c_str());
+    const int last =
+        dash == string::npos ? first : std::atoi(part.substr(dash + 1).c_str());
+    for (int cpu = first; cpu <= last && !part.empty(); ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+// a duration like "500ms", "30s", "10m" or "2h", plain numbers are seconds
+inline std::chrono::nanoseconds parseDuration(const string &text) {
+  char *unit = nullptr;
+  const double value = std::strtod(text.c_str(), &unit);
+  const string suffix = unit;
+  const double seconds = suffix == "ms"  ? value / 1e3
+                         : suffix == "m" ? value * 60
+                         : suffix == "h" ? value * 3600
+                                         : value;
+  return std::chrono::nanoseconds(static_cast<std::int64_t>(seconds * 1e9));
+}
+
+// a size like "512K", "64M" or "2G" in bytes
+inline std::uint64_t parseBytes(const string &size) {
+  char *unit = nullptr;
+  const double value = std::strtod(size.c_str(), &unit);
+  switch (*unit) {
+  case 'g':
+  case 'G':
+    return static_cast<std::uint64_t>(value * (1 << 30));
+  case 'm':
+  case 'M':
+    return static_cast<std::uint64_t>(value * (1 << 20));
+  case 'k':
+  case 'K':
+    return static_cast<std::uint64_t>(value * (1 << 10));
+  default:
+    return static_cast<std::uint64_t>(value);
+  }
+}
+
+// the inverse of parseCpuList for ascending numbers, "0-3,7"
+inline string formatList(const vector<std::size_t> &numbers) {
+  std::ostringstream out;
+  for (std::size_t i = 0; i < numbers.size();) {
+    std::size_t last = i;
+    while (last + 1 < numbers.size() &&
+           numbers[last + 1] == numbers[last] + 1) {
+      ++last;
+    }
+    out << (i ? "," : "") << numbers[i];
+    if (last > i) {
+      out << "-" << numbers[last];
+    }
+    i = last + 1;
+  }
+  return out.str();
+}
+
+// glob match supporting * and ?
+inline bool globMatch(const char *pattern, const char *text) {
+  if (*pattern == '*') {
+    return globMatch(pattern + 1, text) ||
+           (*text && globMatch(pattern, text + 1));
+  }
+  if (!*pattern || !*text) {
+    return !*pattern && !*text;
+  }
+  return (*pattern == '?' || *pattern == *text) &&
+         globMatch(pattern + 1, text + 1);
+}
+
+// settings passed on the command line to RunAllTests(argc, argv)
+struct options {
+  void parse(int argc, char *argv[]) {
+    program = argc ? argv[0] : "";
+    for (int i = 1; i < argc; ++i) {
+      const string arg = argv[i];
+      const auto eq = arg.find('=');
+      const string key = arg.substr(0, eq);
+      const string value = eq == string::npos ? "" : arg.substr(eq + 1);
+      arguments.push_back(arg);
+
+      if (key == "--filter") {
+        std::istringstream in(value);
+        string pattern;
+        while (std::getline(in, pattern, ',')) {
+          filter.push_back(pattern);
+        }
+      } else if (key == "--benchmarks-only") {
+        benchonly = true;
+      } else if (key == "--benchmark-repetitions-process") {
+        benchprocesses = std::strtoul(value.c_str(), nullptr, 10);
+        arguments.pop_back();
+      } else if (key == "--benchmark-records") {
+        benchrecords = true;
+      } else if (key == "--explore-runs") {
+        exploreruns = std::strtoul(value.c_str(), nullptr, 10);
+      } else if (key == "--explore-preemptions") {
+        explorepreemptions = std::strtoul(value.c_str(), nullptr, 10);
+      } else if (key == "--explore-seed") {
+        exploreseed = std::strtoull(value.c_str(), nullptr, 10);
+      } else if (key == "--explore-replay") {
+        explorereplay.clear();
+        for (int id : parseCpuList(value)) {
+          explorereplay.push_back(id);
+        }
+      } else if (key == "--stress-yield") {
+        stressyield = std::atof(value.c_str());
+      } else if (key == "--benchmark-cpus") {
+        benchcpus = parseCpuList(value);
+      } else if (key == "--benchmark-cold-cache") {
+        coldcache = true;
+      } else if (key == "--recover-crashes") {
+        recovercrashes = true;
+      } else if (key == "--fail-fast") {
+        failfast = true;
+      } else if (key == "--shuffle") {
+        shuffle = true;
+      } else if (key == "--seed") {
+        seed = std::strtoull(value.c_str(), nullptr, 10);
+      } else if (key == "--repeat") {
+        repeat = std::strtoul(value.c_str(), nullptr, 10);
+      } else if (key == "--until-fail") {
+        untilfail = true;
+      } else if (key == "--retries") {
+        retries = std::strtoul(value.c_str(), nullptr, 10);
+      } else if (key == "--test-records") {
+        testrecords = true;
+      } else if (key == "--bisect-pollution") {
+        bisect = value;
+      } else if (key == "--run-order") {
+        runorder = value;
+      } else if (key == "--resource-usage") {
+        resourceusage = true;
+      } else if (key == "--memory-budget") {
+        memorybudget = parseBytes(value);
+      } else if (key == "--soak") {
+        soak = parseDuration(value);
+      } else if (key == "--trace") {
+        trace = value.empty() ? "jtest_trace.json" : value;
+      } else if (key == "--capture") {
+        capture = true;
+      } else if (key == "--jobs") {
+        jobs = std::strtoul(value.c_str(), nullptr, 10);
+        jobs = std::max<std::size_t>(1, jobs);
+      } else if (key == "--zygote") {
+        zygote = value.empty() ? 1 : std::strtoul(value.c_str(), nullptr, 10);
+      } else {
+        std::cout << WARNINGSTATUS << "\tunknown option " << arg << std::endl;
+      }
+    }
+  }
+
+  // benchmark thread i is pinned to benchcpus[i % benchcpus.size()]
+  vector<int> benchcpus;
+  // evict the caches before every benchmark iteration
+  bool coldcache = false;
+  // at most this many schedules are tried per JTEST_EXPLORE
+  std::size_t exploreruns = 1000;
+  // schedules switch away from a thread that could continue at most this often
+  std::size_t explorepreemptions = 2;
+  // seed of the random schedules, picked at random when 0
+  std::uint64_t exploreseed = 0;
+  // a schedule printed by a failing JTEST_EXPLORE, the only one that is run
+  vector<std::size_t> explorereplay;
+  // chance in percent that a JTEST_YIELD_POINT() yields or spins
+  double stressyield = 0;
+  // ENV.name patterns, only matching tests and benchmarks run
+  vector<string> filter;
+  bool benchonly = false;
+  // rerun the benchmarks in this many fresh processes
+  std::size_t benchprocesses = 0;
+  // print machine readable results, used by the rerun processes
+  bool benchrecords = false;
+  // a test that crashes is reported and the run goes on in the same process
+  bool recovercrashes = false;
+  // run the tests in batches of this size in children forked from the
+  // initialized process
+  std::size_t zygote = 0;
+  // tests run on this many worker threads (processes with --zygote)
+  std::size_t jobs = 1;
+  // keep what tests write and only show it for the ones that fail, always on
+  // when tests run in parallel
+  bool capture = false;
+  // stop at the first test that doesn't pass
+  bool failfast = false;
+  // run the tests in a random order, across environments
+  bool shuffle = false;
+  // seed of --shuffle, picked at random when 0
+  std::uint64_t seed = 0;
+  // run the tests this many times
+  std::size_t repeat = 0;
+  // run the tests again and again until one fails, at most --repeat times
+  bool untilfail = false;
+  // rerun every failed test this many times, each in a fresh process
+  std::size_t retries = 0;
+  // print one line per test, used by the retry processes
+  bool testrecords = false;
+  // ENV.name of a test that fails only after others, find the ones to blame
+  string bisect;
+  // positions in the run order of the tests to run, all others are left out
+  string runorder;
+  // print the time, faults and context switches of every test
+  bool resourceusage = false;
+  // a test whose resident set peaks higher than this many bytes fails
+  std::uint64_t memorybudget = 0;
+  // run the selected tests over and over for this long and watch the memory
+  std::chrono::nanoseconds soak{0};
+  // write a trace-event timeline of the tests to this file
+  string trace;
+
+  string program;
+  // the command line without the program and the options that start reruns
+  vector<string> arguments;
+};
+
+inline options &settings() {
+  static options o{};
+  return o;
+}
+
+// whether ENV.name passes --filter
+inline bool selected(const string &envname, const string &name) {
+  auto &filter = settings().filter;
+  const string full = envname + "." + name;
+  return filter.empty() ||
+         std::any_of(filter.begin(), filter.end(), [&](const string &p) {
+           return globMatch(p.c_str(), full.c_str());
+         });
+}
+
+using clock = std::chrono::steady_clock;
+
+// tells the cpu the calling thread is busy waiting
+inline void cpuRelax() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_ia32_pause();
+#elif defined(__GNUC__) && defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// a one-shot barrier the threads busy wait on so they all leave it within a
+// few cycles of each other, after a while it yields in case there are more
+// threads than cpus
+class spinbarrier {
+public:
+  explicit spinbarrier(std::size_t count) : _waiting(count) {}
+
+  void arriveAndWait() {
+    _waiting.fetch_sub(1, std::memory_order_acq_rel);
+    for (unsigned spins = 0; _waiting.load(std::memory_order_acquire);
+         ++spins) {
+      if (spins < 1u << 16) {
+        cpuRelax();
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+private:
+  std::atomic<std::size_t> _waiting;
+};
+
+// small and fast random numbers for yield points, one generator per thread
+inline std::uint64_t threadRandom() {
+  thread_local std::uint64_t state =
+      std::hash<std::thread::id>{}(std::this_thread::get_id()) | 1;
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+// set on threads running the body of a JTEST_STRESS
+inline bool &stressing() {
+  thread_local bool active = false;
+  return active;
+}
+
+// thrown into the threads of an exploration run that has to stop early, the
+// exploration catches it
+struct explorationaborted {};
+
+// serializes the threads of one JTEST_EXPLORE run: exactly one of them runs at
+// a time and every operation on a JTest::explore object is a point where the
+// scheduler decides which thread continues. The choices are forced from a
+// recorded schedule, random, or else keep the running thread going.
+class scheduler {
+public:
+  static constexpr std::size_t none = static_cast<std::size_t>(-1);
+
+  // one scheduling decision
+  struct point {
+    // the threads that could continue, the default choice first
+    vector<std::size_t> order;
+    // index into order
+    std::size_t chosen;
+    std::size_t current;
+    bool currentEnabled;
+    // how often a thread that could continue was switched away from before
+    std::size_t preemptions;
+  };
+
+  scheduler(vector<std::size_t> forced, bool random, std::uint64_t seed)
+      : _forced(std::move(forced)), _random(random), _rng(seed) {
+    _threads.emplace_back();
+  }
+
+  // the scheduler and managed thread id of the calling thread
+  static scheduler *&active() {
+    thread_local scheduler *running = nullptr;
+    return running;
+  }
+  static std::size_t &self() {
+    thread_local std::size_t id = 0;
+    return id;
+  }
+
+  // runs body as managed thread 0, returns the exception that flawed the run
+  template <class BODY> std::exception_ptr run(test &t, BODY &&body) {
+    active() = this;
+    self() = 0;
+    t.begin();
+    JTEST_TRY {
+      body(t);
+      std::unique_lock<std::mutex> guard{_lock};
+      _threads[0].joinall = true;
+      switchTo(guard);
+    } JTEST_CATCH(explorationaborted &) {
+    } JTEST_CATCH(...) {
+      fail(std::current_exception());
+    }
+    t.end();
+    active() = nullptr;
+    return _thrown;
+  }
+
+  // registers a new thread, it runs once it gets chosen
+  std::size_t spawn() {
+    std::lock_guard<std::mutex> guard{_lock};
+    _threads.emplace_back();
+    return _threads.size() - 1;
+  }
+
+  // called on the new thread, false when the run was aborted meanwhile
+  bool start(std::size_t id) {
+    active() = this;
+    self() = id;
+    std::unique_lock<std::mutex> guard{_lock};
+    _turn.wait(guard, [&] { return _active == id || _aborted; });
+    return !_aborted;
+  }
+
+  void finish() {
+    std::unique_lock<std::mutex> guard{_lock};
+    _threads[self()].finished = true;
+    if (_aborted) {
+      return;
+    }
+    const std::size_t next = choose();
+    if (next == none) {
+      if (std::any_of(_threads.begin(), _threads.end(),
+                      [](managed &m) { return !m.finished; })) {
+        abort("deadlock, no thread can continue");
+      }
+      return;
+    }
+    _active = next;
+    _turn.notify_all();
+  }
+
+  void yieldPoint() {
+    std::unique_lock<std::mutex> guard{_lock};
+    switchTo(guard);
+  }
+
+  void lock(std::size_t &owner) {
+    std::unique_lock<std::mutex> guard{_lock};
+    switchTo(guard);
+    while (owner != none) {
+      _threads[self()].waitowner = &owner;
+      switchTo(guard);
+    }
+    _threads[self()].waitowner = nullptr;
+    owner = self();
+  }
+
+  bool tryLock(std::size_t &owner) {
+    std::unique_lock<std::mutex> guard{_lock};
+    switchTo(guard);
+    if (owner != none) {
+      return false;
+    }
+    owner = self();
+    return true;
+  }
+
+  void unlock(std::size_t &owner) {
+    std::unique_lock<std::mutex> guard{_lock};
+    owner = none;
+    switchTo(guard);
+  }
+
+  void join(std::size_t id) {
+    std::unique_lock<std::mutex> guard{_lock};
+    while (!_threads[id].finished) {
+      _threads[self()].joining = id;
+      switchTo(guard);
+    }
+    _threads[self()].joining = none;
+  }
+
+  // stops the run, every managed thread throws explorationaborted at its next
+  // scheduling point
+  void fail(std::exception_ptr thrown) {
+    std::lock_guard<std::mutex> guard{_lock};
+    if (!_thrown) {
+      _thrown = thrown;
+    }
+    abort("an exception was thrown and not caught");
+  }
+
+  bool aborted() {
+    std::lock_guard<std::mutex> guard{_lock};
+    return _aborted;
+  }
+
+  const string &reason() const { return _reason; }
+
+  // the thread chosen at every scheduling point, --explore-replay takes this
+  string schedule() const {
+    std::ostringstream out;
+    for (std::size_t i = 0; i < _points.size(); ++i) {
+      out << (i ? "," : "") << _points[i].order[_points[i].chosen];
+    }
+    return out.str();
+  }
+
+  // depth first search over the schedules with at most bound preemptions:
+  // the next schedule repeats this one up to the last decision that still has
+  // an untried alternative within the bound, false when there is none left
+  bool backtrack(vector<std::size_t> &forced, std::size_t bound) const {
+    for (std::size_t i = _points.size(); i--;) {
+      const point &p = _points[i];
+      for (std::size_t alt = p.chosen + 1; alt < p.order.size(); ++alt) {
+        const bool preempts = p.currentEnabled && p.order[alt] != p.current;
+        if (p.preemptions + preempts <= bound) {
+          forced.clear();
+          for (std::size_t j = 0; j < i; ++j) {
+            forced.push_back(_points[j].order[_points[j].chosen]);
+          }
+          forced.push_back(p.order[alt]);
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+private:
+  struct managed {
+    bool finished = false;
+    // set while waiting for a mutex owned by another thread
+    const std::size_t *waitowner = nullptr;
+    std::size_t joining = none;
+    // thread 0 waits for all others when the body returns
+    bool joinall = false;
+  };
+
+  bool enabled(std::size_t id) const {
+    const managed &m = _threads[id];
+    if (m.finished || (m.waitowner && *m.waitowner != none) ||
+        (m.joining != none && !_threads[m.joining].finished)) {
+      return false;
+    }
+    if (m.joinall) {
+      for (std::size_t i = 1; i < _threads.size(); ++i) {
+        if (!_threads[i].finished) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  std::size_t choose() {
+    vector<std::size_t> order;
+    const std::size_t current = self();
+    const bool currentEnabled = enabled(current);
+    if (currentEnabled) {
+      order.push_back(current);
+    }
+    for (std::size_t i = 0; i < _threads.size(); ++i) {
+      if (i != current && enabled(i)) {
+        order.push_back(i);
+      }
+    }
+    if (order.empty()) {
+      return none;
+    }
+
+    std::size_t chosen = 0;
+    if (_points.size() < _forced.size()) {
+      auto forced = std::find(order.begin(), order.end(),
+                              _forced[_points.size()]);
+      chosen = forced == order.end() ? 0 : forced - order.begin();
+    } else if (_random) {
+      chosen = _rng() % order.size();
+    }
+    _points.push_back(
+        point{order, chosen, current, currentEnabled, _preemptions});
+    if (currentEnabled && order[chosen] != current) {
+      ++_preemptions;
+    }
+    return order[chosen];
+  }
+
+  // hands the turn to the chosen thread and waits for it to come back
+  void switchTo(std::unique_lock<std::mutex> &guard) {
+    if (_aborted) {
+      JTEST_THROW(explorationaborted{});
+    }
+    const std::size_t next = choose();
+    if (next == none) {
+      abort("deadlock, no thread can continue");
+      JTEST_THROW(explorationaborted{});
+    }
+    if (next != self()) {
+      _active = next;
+      _turn.notify_all();
+      const std::size_t me = self();
+      _turn.wait(guard, [&] { return _active == me || _aborted; });
+      if (_aborted) {
+        JTEST_THROW(explorationaborted{});
+      }
+    }
+  }
+
+  // expects _lock to be held
+  void abort(const string &reason) {
+    if (!_aborted) {
+      _aborted = true;
+      _reason = reason;
+    }
+    _turn.notify_all();
+  }
+
+  std::mutex _lock;
+  std::condition_variable _turn;
+  std::deque<managed> _threads;
+  std::size_t _active = 0;
+  bool _aborted = false;
+  string _reason;
+  std::exception_ptr _thrown;
+
+  vector<std::size_t> _forced;
+  bool _random;
+  std::mt19937_64 _rng;
+  vector<point> _points;
+  std::size_t _preemptions = 0;
+};
+
+inline void yieldPoint() {
+  if (scheduler *s = scheduler::active()) {
+    s->yieldPoint();
+    return;
+  }
+  const double chance = settings().stressyield;
+  if (!stressing() || chance <= 0 ||
+      threadRandom() % 10000 >= static_cast<std::uint64_t>(chance * 100)) {
+    return;
+  }
+  const std::uint64_t choice = threadRandom();
+  if (choice & 1) {
+    std::this_thread::yield();
+  } else {
+    for (std::uint64_t i = (choice >> 1) % 2048; i; --i) {
+      cpuRelax();
+    }
+  }
+}
+
+// what a test and the threads it started write to the standard streams
+struct capture {
+  std::mutex lock;
+  string text;
+
+  // the capture of the calling thread, JTest::thread, JTEST_STRESS and
+  // explore::thread carry it over
+  static capture *&current() {
+    thread_local capture *active = nullptr;
+    return active;
+  }
+};
+
+// runs body(t) iterations times on each of the threads at once, failures of
+// every thread count towards t, an exception on any thread flaws the test
+template <class BODY>
+void stress(test &t, std::size_t threads, std::size_t iterations, BODY &&body) {
+  spinbarrier start{threads};
+  std::exception_ptr thrown;
+  std::mutex thrownlock;
+
+  capture *output = capture::current();
+  vector<std::thread> workers;
+  for (std::size_t i = 0; i < threads; ++i) {
+    workers.emplace_back([&] {
+      test::current() = &t;
+      capture::current() = output;
+      stressing() = true;
+      start.arriveAndWait();
+      JTEST_TRY {
+        for (std::size_t j = 0; j < iterations; ++j) {
+          body(t);
+        }
+      } JTEST_CATCH(...) {
+        std::lock_guard<std::mutex> guard{thrownlock};
+        thrown = std::current_exception();
+      }
+    });
+  }
+  for (auto &w : workers) {
+    w.join();
+  }
+  if (thrown) {
+    std::rethrow_exception(thrown);
+  }
+}
+
+inline double nanoseconds(clock::duration d) {
+  return std::chrono::duration<double, std::nano>(d).count();
+}
+
+// human readable duration for a value in nanoseconds
+inline string formatTime(double ns) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1);
+  if (ns < 1e3) {
+    out << ns << " ns";
+  } else if (ns < 1e6) {
+    out << ns / 1e3 << " us";
+  } else if (ns < 1e9) {
+    out << ns / 1e6 << " ms";
+  } else {
+    out << ns / 1e9 << " s";
+  }
+  return out.str();
+}
+
+// human readable amount of operations per second
+inline string formatRate(double persec) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1);
+  if (persec < 1e3) {
+    out << persec << " op/s";
+  } else if (persec < 1e6) {
+    out << persec / 1e3 << " kop/s";
+  } else {
+    out << persec / 1e6 << " Mop/s";
+  }
+  return out.str();
+}
+
+// human readable amount of memory
+inline string formatBytes(double bytes) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1);
+  if (bytes < 1 << 10) {
+    out << bytes << " B";
+  } else if (bytes < 1 << 20) {
+    out << bytes / (1 << 10) << " KiB";
+  } else if (bytes < 1 << 30) {
+    out << bytes / (1 << 20) << " MiB";
+  } else {
+    out << bytes / (1 << 30) << " GiB";
+  }
+  return out.str();
+}
+
+// nearest-rank percentile, sorted has to be in ascending order
+inline double percentile(const vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  std::size_t rank = static_cast<std::size_t>(p / 100 * sorted.size() + 0.5);
+  return sorted[std::min(rank ? rank - 1 : 0, sorted.size() - 1)];
+}
+
+// column aligned text, benchmarks fill one in and the runner prints it
+struct table {
+  void row(vector<string> &&cols) { rows.push_back(cols); }
+
+  void print() const {
+    vector<std::size_t> widths;
+    for (auto &r : rows) {
+      widths.resize(std::max(widths.size(), r.size()));
+      for (std::size_t i = 0; i < r.size(); ++i) {
+        widths[i] = std::max(widths[i], r[i].size());
+      }
+    }
+    for (auto &r : rows) {
+      std::cout << "\t\t";
+      for (std::size_t i = 0; i < r.size(); ++i) {
+        std::cout << std::setw(widths[i] + 2) << r[i];
+      }
+      std::cout << std::endl;
+    }
+  }
+
+  vector<vector<string>> rows;
+};
+
+struct bench {
+  bench(string &&name, benchfunc func)
+      : b_ctx(string(name), nullptr), b_name(name), b_func(func) {}
+
+  void operator()() {
+    b_ctx.begin();
+    JTEST_TRY {
+      b_func(*this);
+    } JTEST_CATCH(...) {
+      b_ctx.end();
+      JTEST_RETHROW;
+    }
+    b_ctx.end();
+  }
+
+  inline void prettyPrint() {
+    std::cout << "\t" << CONSOLEBLUE << b_name << CONSOLEDEFAULT << ": ";
+  }
+
+  // expectations inside a benchmark body are recorded here
+  test b_ctx;
+  table b_table;
+  list<string> b_notes;
+  // the headline number (time per operation or latency in ns) of every table
+  // row, labeled by the first column, these are compared across processes
+  string b_column;
+  vector<std::pair<string, double>> b_results;
+  // set when the benchmark already ran in other processes
+  bool b_done = false;
+  bool b_flawed = false;
+  string b_name;
+  benchfunc b_func;
+};
+
+// pins the calling thread to the index-th benchmark cpu, restores the old
+// affinity when it goes out of scope
+class pinning {
+public:
+  explicit pinning(std::size_t index) {
+    auto &cpus = settings().benchcpus;
+    if (cpus.empty()) {
+      return;
+    }
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[index % cpus.size()], &set);
+    pinned = !sched_getaffinity(0, sizeof(previous), &previous) &&
+             !sched_setaffinity(0, sizeof(set), &set);
+#endif
+  }
+
+  ~pinning() {
+#ifdef __linux__
+    if (pinned) {
+      sched_setaffinity(0, sizeof(previous), &previous);
+    }
+#endif
+  }
+
+private:
+  bool pinned = false;
+#ifdef __linux__
+  cpu_set_t previous;
+#endif
+};
+
+// size of the largest cache the first cpu reports, 32MB if there is none
+inline std::size_t largestCache() {
+  std::size_t largest = 0;
+  for (int i = 0; i < 8; ++i) {
+    const string size = readLine("/sys/devices/system/cpu/cpu0/cache/index" +
+                                 std::to_string(i) + "/size");
+    if (size.empty()) {
+      continue;
+    }
+    std::size_t bytes = std::strtoull(size.c_str(), nullptr, 10);
+    if (size.back() == 'K') {
+      bytes <<= 10;
+    } else if (size.back() == 'M') {
+      bytes <<= 20;
+    }
+    largest = std::max(largest, bytes);
+  }
+  return largest ? largest : std::size_t{32} << 20;
+}
+
+// streams through a buffer twice the size of the largest cache (at most 128MB)
+// so the next iteration finds nothing of its own data in the caches
+inline void evictCaches() {
+  static vector<char> buffer(
+      std::min(2 * largestCache(), std::size_t{128} << 20), 1);
+  char sum = 0;
+  for (std::size_t i = 0; i < buffer.size(); i += 64) {
+    sum = static_cast<char>(sum + buffer[i]);
+  }
+  volatile char sink = sum;
+  (void)sink;
+}
+
+// describes what the benchmarks ran under, warnings are printed for everything
+// that makes timings noisy
+inline string benchEnvironment(bool warn, bool caches = true) {
+  std::ostringstream out;
+  auto &cpus = settings().benchcpus;
+  if (caches) {
+    out << (settings().coldcache ? "cold cache, " : "warm cache, ");
+  }
+  if (cpus.empty()) {
+    out << "not pinned";
+  } else {
+    out << "pinned to cpu";
+    for (std::size_t i = 0; i < cpus.size(); ++i) {
+      out << (i ? "," : " ") << cpus[i];
+    }
+  }
+#ifdef __linux__
+  const string cpuroot = "/sys/devices/system/cpu/";
+  const vector<int> isolated = parseCpuList(readLine(cpuroot + "isolated"));
+  for (int cpu : cpus) {
+    if (warn && std::find(isolated.begin(), isolated.end(), cpu) ==
+                    isolated.end()) {
+      std::cout << WARNINGSTATUS << "\tcpu " << cpu
+                << " is not isolated, other processes may run on it"
+                << std::endl;
+    }
+  }
+
+  vector<int> checked = cpus;
+  if (checked.empty()) {
+    checked = parseCpuList(readLine(cpuroot + "online"));
+  }
+  string governor;
+  for (int cpu : checked) {
+    const string g = readLine(cpuroot + "cpu" + std::to_string(cpu) +
+                              "/cpufreq/scaling_governor");
+    if (!g.empty() && g != "performance") {
+      governor = g;
+    } else if (governor.empty()) {
+      governor = g;
+    }
+  }
+  if (!governor.empty()) {
+    out << ", governor " << governor;
+    if (warn && governor != "performance") {
+      std::cout << WARNINGSTATUS << "\tcpu frequency scaling is active ("
+                << governor << " governor)" << std::endl;
+    }
+  }
+
+  const string noturbo = readLine(cpuroot + "intel_pstate/no_turbo");
+  const string boost = readLine(cpuroot + "cpufreq/boost");
+  if (noturbo == "0" || boost == "1") {
+    out << ", turbo on";
+    if (warn) {
+      std::cout << WARNINGSTATUS << "\tturbo boost is active" << std::endl;
+    }
+  } else if (noturbo == "1" || boost == "0") {
+    out << ", turbo off";
+  }
+#else
+  if (warn && !cpus.empty()) {
+    std::cout << WARNINGSTATUS << "\tpinning is only supported on linux"
+              << std::endl;
+  }
+#endif
+  return out.str();
+}
+
+// open-loop load generation: operations are due at fixed intended start times
+// and latency is measured from that intended start, so a stall in the system
+// under test is charged to every operation queued behind it instead of
+// silently slowing down the generator (coordinated omission). The thread that
+// runs them waits for each start itself, sleeping and then spinning for the
+// last JLOAD_SPIN_US, a timer or a wake-up of another thread would add tens of
+// microseconds to every operation. How late it still started one it had to
+// wait for is the generator's own lateness and is reported on its own.
+template <class OP> void openloop(bench &b, double rate, OP &&op) {
+  const auto interval = std::chrono::duration_cast<clock::duration>(
+      std::chrono::duration<double>(1 / rate));
+  const std::size_t total =
+      std::max<std::size_t>(1, rate * JLOAD_DURATION_MS / 1000);
+  const auto spin = std::chrono::microseconds(JLOAD_SPIN_US);
+
+  pinning pin{0};
+  vector<double> latency, service, lateness;
+  latency.reserve(total);
+  service.reserve(total);
+  lateness.reserve(total);
+
+  const auto start = clock::now();
+  for (std::size_t i = 0; i < total; ++i) {
+    const auto intended = start + interval * static_cast<long long>(i);
+    auto now = clock::now();
+    const bool early = now < intended;
+    if (intended - now > spin) {
+      std::this_thread::sleep_until(intended - spin);
+    }
+    while ((now = clock::now()) < intended) {
+      cpuRelax();
+    }
+    if (early) {
+      lateness.push_back(nanoseconds(now - intended));
+    }
+
+    op(b.b_ctx);
+    const auto ended = clock::now();
+    latency.push_back(nanoseconds(ended - intended));
+    service.push_back(nanoseconds(ended - now));
+  }
+  const double elapsed = nanoseconds(clock::now() - start) / 1e9;
+
+  std::sort(latency.begin(), latency.end());
+  std::sort(service.begin(), service.end());
+  std::sort(lateness.begin(), lateness.end());
+
+  b.b_table.row({"percentile", "latency", "service time"});
+  for (double p : {50.0, 90.0, 99.0, 99.9, 99.99, 100.0}) {
+    std::ostringstream label;
+    label << "p" << p;
+    b.b_table.row({label.str(), formatTime(percentile(latency, p)),
+                   formatTime(percentile(service, p))});
+    b.b_results.emplace_back(label.str(), percentile(latency, p));
+  }
+  b.b_column = "percentile";
+  b.b_notes.push_back("target " + formatRate(rate) + ", achieved " +
+                      formatRate(latency.size() / elapsed) + " over " +
+                      std::to_string(latency.size()) + " operations");
+  b.b_notes.push_back("latency is measured from the intended start, service "
+                      "time from the actual start");
+  if (!lateness.empty()) {
+    b.b_notes.push_back("the generator started " +
+                        std::to_string(lateness.size()) +
+                        " operations it waited for up to " +
+                        formatTime(lateness.back()) + " late (p99 " +
+                        formatTime(percentile(lateness, 99)) + ")");
+  }
+  b.b_notes.push_back(benchEnvironment(false, false));
+}
+
+#ifdef JTEST_POSIX
+// the command line for a process that reruns some of the tests or the
+// benchmarks, without the options that schedule the run, the --trace only the
+// parent writes and those in dropped
+inline vector<string>
+rerunArguments(std::initializer_list<const char *> dropped = {}) {
+  static const char *scheduling[] = {
+      "--retries",   "--repeat",    "--until-fail",      "--jobs",
+      "--zygote",    "--fail-fast", "--benchmarks-only", "--run-order",
+      "--bisect-pollution", "--soak", "--trace"};
+  vector<string> arguments;
+  for (auto &arg : settings().arguments) {
+    const string key = arg.substr(0, arg.find('='));
+    auto is = [&](const char *option) { return key == option; };
+    if (std::none_of(std::begin(scheduling), std::end(scheduling), is) &&
+        std::none_of(dropped.begin(), dropped.end(), is)) {
+      arguments.push_back(arg);
+    }
+  }
+  return arguments;
+}
+
+// runs this program again with the given arguments and returns what it wrote
+// to stdout, the fresh process gets its own address space layout. Safe to call
+// from several threads at once.
+inline string runSelf(const vector<string> &arguments) {
+  int out[2];
+  if (pipe(out)) {
+    return "";
+  }
+  // other children started meanwhile must not keep the pipe open
+  fcntl(out[0], F_SETFD, FD_CLOEXEC);
+  fcntl(out[1], F_SETFD, FD_CLOEXEC);
+  string self = settings().program;
+#ifdef __linux__
+  self = "/proc/self/exe";
+#endif
+  vector<char *> argv{const_cast<char *>(settings().program.c_str())};
+  for (auto &arg : arguments) {
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  const pid_t child = fork();
+  if (child == 0) {
+    dup2(out[1], STDOUT_FILENO);
+    close(out[0]);
+    close(out[1]);
+    execv(self.c_str(), argv.data());
+    _exit(127);
+  }
+  close(out[1]);
+  string output;
+  char buffer[4096];
+  ssize_t got;
+  while ((got = read(out[0], buffer, sizeof(buffer))) > 0) {
+    output.append(buffer, got);
+  }
+  close(out[0]);
+  int status;
+  waitpid(child, &status, 0);
+  return output;
+}
+#endif
+
+// two-sided 95% student-t critical value
+inline double studentT95(std::size_t freedom) {
+  static const double table[] = {
+      12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+      2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+      2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+  return freedom == 0 ? 0 : freedom <= 30 ? table[freedom - 1] : 1.96;
+}
+
+// fills the table of a benchmark with the mean and 95% confidence interval of
+// every row across processes
+inline void aggregate(bench &b, const string &column,
+                      const vector<std::pair<string, vector<double>>> &rows,
+                      std::size_t processes) {
+  b.b_table.row({column, "mean", "95% CI", "min", "max"});
+  for (auto &r : rows) {
+    const auto &values = r.second;
+    double mean = 0, squares = 0;
+    for (double v : values) {
+      mean += v / values.size();
+    }
+    for (double v : values) {
+      squares += (v - mean) * (v - mean);
+    }
+    const double deviation =
+        values.size() > 1 ? std::sqrt(squares / (values.size() - 1)) : 0;
+    const double interval = studentT95(values.size() - 1) * deviation /
+                            std::sqrt(static_cast<double>(values.size()));
+    std::ostringstream ci;
+    ci << "+-" << std::fixed << std::setprecision(1)
+       << (mean ? 100 * interval / mean : 0) << "%";
+    const auto extremes = std::minmax_element(values.begin(), values.end());
+    b.b_table.row({r.first, formatTime(mean), ci.str(),
+                   formatTime(*extremes.first), formatTime(*extremes.second)});
+  }
+  b.b_notes.push_back("across " + std::to_string(processes) + " processes, " +
+                      benchEnvironment(false));
+}
+
+struct benchconfig {
+  std::size_t minthreads;
+  std::size_t maxthreads;
+  std::size_t minsize = 0;
+  std::size_t maxsize = 0;
+  // a sweep fails when its best fit grows faster than this
+  complexity expected = complexity::on2;
+};
+
+// one timed run of a benchmark, elapsed only counts the time spent in the
+// body while wall also counts cache eviction
+struct measurement {
+  double elapsed;
+  double wall;
+};
+
+// runs the iterations on the calling thread, in cold cache mode the caches are
+// evicted before every iteration and only the iterations themselves are timed
+template <class SUITE>
+double timeIterations(bench &b, SUITE &suite,
+                      void (SUITE::*loop)(test &, std::size_t),
+                      std::size_t iterations) {
+  if (!settings().coldcache) {
+    const auto began = clock::now();
+    (suite.*loop)(b.b_ctx, iterations);
+    return nanoseconds(clock::now() - began);
+  }
+  double elapsed = 0;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    evictCaches();
+    const auto began = clock::now();
+    (suite.*loop)(b.b_ctx, 1);
+    elapsed += nanoseconds(clock::now() - began);
+  }
+  return elapsed;
+}
+
+// runs the iterations on every thread at once, the threads spin on a common
+// barrier so none of them gets a head start, the time runs from release until
+// the last thread finished
+template <class SUITE>
+measurement measure(bench &b, SUITE &suite,
+                    void (SUITE::*loop)(test &, std::size_t),
+                    std::size_t threads, std::size_t iterations) {
+  if (threads == 1) {
+    const auto began = clock::now();
+    const double elapsed = timeIterations(b, suite, loop, iterations);
+    return {elapsed, nanoseconds(clock::now() - began)};
+  }
+
+  std::atomic<std::size_t> arrived{0};
+  std::atomic<bool> released{false};
+  std::exception_ptr thrown;
+  std::mutex resultlock;
+  double slowest = 0;
+
+  vector<std::thread> workers;
+  for (std::size_t i = 0; i < threads; ++i) {
+    workers.emplace_back([&, i] {
+      pinning pin{i};
+      arrived.fetch_add(1);
+      while (!released.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      JTEST_TRY {
+        const double elapsed = timeIterations(b, suite, loop, iterations);
+        std::lock_guard<std::mutex> guard{resultlock};
+        slowest = std::max(slowest, elapsed);
+      } JTEST_CATCH(...) {
+        std::lock_guard<std::mutex> guard{resultlock};
+        thrown = std::current_exception();
+      }
+    });
+  }
+  while (arrived.load() != threads) {
+    std::this_thread::yield();
+  }
+  const auto began = clock::now();
+  released.store(true, std::memory_order_release);
+  for (auto &w : workers) {
+    w.join();
+  }
+  const double wall = nanoseconds(clock::now() - began);
+  if (thrown) {
+    std::rethrow_exception(thrown);
+  }
+  return {settings().coldcache ? slowest : wall, wall};
+}
+
+inline double complexityOf(complexity c, double n) {
+  switch (c) {
+  case complexity::o1:
+    return 1;
+  case complexity::ologn:
+    return std::log2(n);
+  case complexity::on:
+    return n;
+  case complexity::onlogn:
+    return n * std::log2(n);
+  default:
+    return n * n;
+  }
+}
+
+inline const char *complexityName(complexity c) {
+  const char *names[] = {"O(1)", "O(log n)", "O(n)", "O(n log n)", "O(n^2)"};
+  return names[static_cast<int>(c)];
+}
+
+// least squares fit of time = coefficient * f(n) for every complexity class.
+// O(n) and O(n log n) differ by a few percent over the sizes, so the simplest
+// class whose RMS error (relative to the mean time) is within 3 points of the
+// smallest one wins. An expected class fails only when it fits clearly worse,
+// with more than twice the smallest error plus 5 points.
+inline void fitComplexity(bench &b, const vector<double> &sizes,
+                          const vector<double> &times, complexity expected) {
+  const int classes = static_cast<int>(complexity::on2) + 1;
+  double rms[classes];
+  double mean = 0;
+  for (double time : times) {
+    mean += time / times.size();
+  }
+  for (int i = 0; i < classes; ++i) {
+    const complexity c = static_cast<complexity>(i);
+    double ff = 0, tf = 0;
+    for (std::size_t j = 0; j < sizes.size(); ++j) {
+      ff += complexityOf(c, sizes[j]) * complexityOf(c, sizes[j]);
+      tf += times[j] * complexityOf(c, sizes[j]);
+    }
+    const double coefficient = tf / ff;
+    double squares = 0;
+    for (std::size_t j = 0; j < sizes.size(); ++j) {
+      const double error = times[j] - coefficient * complexityOf(c, sizes[j]);
+      squares += error * error;
+    }
+    rms[i] = std::sqrt(squares / sizes.size()) / mean;
+  }
+  const double smallest = *std::min_element(rms, rms + classes);
+  int best = 0;
+  while (rms[best] > smallest + 0.03) {
+    ++best;
+  }
+
+  std::ostringstream note;
+  note << std::fixed << std::setprecision(1) << "best fit "
+       << complexityName(static_cast<complexity>(best)) << ", RMS error "
+       << 100 * rms[best] << "%";
+  b.b_notes.push_back(note.str());
+  const int most = static_cast<int>(expected);
+  if (std::all_of(rms, rms + most + 1,
+                  [&](double error) { return error > 2 * smallest + 0.05; })) {
+    std::ostringstream why;
+    why << std::fixed << std::setprecision(1) << "expected at most "
+        << complexityName(expected) << ", RMS error " << 100 * rms[most]
+        << "%";
+    b.b_notes.push_back(why.str());
+    b.b_ctx.incr();
+  }
+}
+
+// finds an iteration count that runs for at least JBENCH_MIN_TIME_MS for each
+// input size and thread count in the configured ranges and reports the
+// throughput of each
+template <class SUITE>
+void timedloop(bench &b, const benchconfig &config,
+               void (SUITE::*loop)(test &, std::size_t)) {
+  pinning pin{0};
+  const double mintime = JBENCH_MIN_TIME_MS * 1e6;
+  const bool scaling = config.maxthreads > config.minthreads;
+  const bool sizing = config.maxsize > 0;
+  vector<double> sizes, times;
+
+  vector<string> header;
+  if (sizing) {
+    header.push_back("size");
+  }
+  if (scaling) {
+    header.push_back("threads");
+  } else if (!sizing) {
+    header.push_back("iterations");
+  }
+  header.push_back("time/op");
+  if (scaling) {
+    header.insert(header.end(), {"aggregate", "per thread", "efficiency"});
+  } else {
+    header.push_back("throughput");
+  }
+  b.b_column = sizing || scaling ? header.front() : "measurement";
+  b.b_table.row(std::move(header));
+
+  for (std::size_t size = std::max<std::size_t>(1, config.minsize);;
+       size = std::min(size * 2, config.maxsize)) {
+    double baseline = 0;
+    for (std::size_t threads = std::max<std::size_t>(1, config.minthreads);;
+         threads = std::min(threads * 2, config.maxthreads)) {
+      SUITE suite{};
+      suite._benchsize = sizing ? size : 0;
+      suite.setup();
+      // in cold cache mode eviction counts towards the minimum time, it would
+      // take forever to collect JBENCH_MIN_TIME_MS of timed iterations
+      std::size_t iterations = 1;
+      measurement m = measure(b, suite, loop, threads, iterations);
+      while ((settings().coldcache ? m.wall : m.elapsed) < mintime) {
+        const double spent = settings().coldcache ? m.wall : m.elapsed;
+        const double wanted = iterations * 1.4 * mintime / std::max(spent, 1.0);
+        iterations = static_cast<std::size_t>(
+                         std::min<double>(wanted, iterations * 10.0)) +
+                     1;
+        m = measure(b, suite, loop, threads, iterations);
+      }
+      suite.teardown();
+      const double elapsed = m.elapsed;
+
+      const double pertime = elapsed / iterations;
+      const double aggregate = threads * iterations / (elapsed / 1e9);
+      vector<string> row;
+      if (sizing) {
+        row.push_back(std::to_string(size));
+      }
+      if (scaling) {
+        const double perthread = aggregate / threads;
+        if (!baseline) {
+          baseline = perthread;
+          sizes.push_back(size);
+          times.push_back(pertime);
+        }
+        std::ostringstream efficiency;
+        efficiency << std::fixed << std::setprecision(1)
+                   << 100 * perthread / baseline << "%";
+        row.insert(row.end(),
+                   {std::to_string(threads), formatTime(pertime),
+                    formatRate(aggregate), formatRate(perthread),
+                    efficiency.str()});
+      } else {
+        sizes.push_back(size);
+        times.push_back(pertime);
+        if (!sizing) {
+          row.push_back(std::to_string(iterations));
+        }
+        row.insert(row.end(), {formatTime(pertime), formatRate(aggregate)});
+      }
+      b.b_results.emplace_back(sizing || scaling ? row.front() : "time/op",
+                               pertime);
+      b.b_table.row(std::move(row));
+
+      if (threads >= config.maxthreads) {
+        break;
+      }
+    }
+    if (!sizing || size >= config.maxsize) {
+      break;
+    }
+  }
+
+  if (sizing && sizes.size() > 1) {
+    fitComplexity(b, sizes, times, config.expected);
+  }
+  b.b_notes.push_back(benchEnvironment(false));
+}
+
+// the buffer of std::cout, std::cerr and std::clog while output is captured:
+// writes of a thread with a capture go there, everything else passes through
+// to the original buffer. It has no buffer of its own, so it never holds
+// characters of two threads at once.
+class capturebuf : public std::streambuf {
+public:
+  explicit capturebuf(std::streambuf *original) : _original(original) {}
+
+  std::streambuf *original() const { return _original; }
+
+protected:
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+      return traits_type::not_eof(c);
+    }
+    const char ch = traits_type::to_char_type(c);
+    return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+  }
+
+  std::streamsize xsputn(const char *text, std::streamsize count) override {
+    if (capture *c = capture::current()) {
+      std::lock_guard<std::mutex> guard{c->lock};
+      c->text.append(text, count);
+      return count;
+    }
+    std::lock_guard<std::mutex> guard{_lock};
+    return _original->sputn(text, count);
+  }
+
+  int sync() override {
+    if (capture::current()) {
+      return 0;
+    }
+    std::lock_guard<std::mutex> guard{_lock};
+    return _original->pubsync();
+  }
+
+private:
+  std::streambuf *_original;
+  std::mutex _lock;
+};
+
+// puts a capturebuf in front of the standard streams while it exists
+class capturing {
+public:
+  capturing()
+      : _out(std::cout.rdbuf()), _err(std::cerr.rdbuf()),
+        _log(std::clog.rdbuf()) {
+    std::cout.rdbuf(&_out);
+    std::cerr.rdbuf(&_err);
+    std::clog.rdbuf(&_log);
+    active() = this;
+  }
+
+  ~capturing() { release(); }
+
+  // the one in front of the streams, if any
+  static capturing *&active() {
+    static capturing *current = nullptr;
+    return current;
+  }
+
+  // gives the streams their own buffers back
+  void release() {
+    std::cout.rdbuf(_out.original());
+    std::cerr.rdbuf(_err.original());
+    std::clog.rdbuf(_log.original());
+    active() = nullptr;
+  }
+
+private:
+  capturebuf _out;
+  capturebuf _err;
+  capturebuf _log;
+};
+
+#ifdef JTEST_POSIX
+// under --recover-crashes a fatal signal raised by a test on the runner thread
+// jumps back to the runner instead of killing the process. The handler runs on
+// its own stack so a stack overflow can be recovered from too. Nothing the
+// test left behind is cleaned up: destructors don't run, locks stay locked.
+class crashguard {
+public:
+  // runs the test, returns the signal it crashed with or 0
+  static int run(test &t, bool &flawed, bool &cancelled) {
+    install();
+    if (const int signal = sigsetjmp(landing(), 1)) {
+      armed() = false;
+      t.end();
+      return signal;
+    }
+    armed() = true;
+    JTEST_TRY {
+      t();
+    } JTEST_CATCH(cancelledtest &) {
+      cancelled = true;
+    } JTEST_CATCH(...) {
+      flawed = true;
+    }
+    armed() = false;
+    return 0;
+  }
+
+private:
+  static sigjmp_buf &landing() {
+    thread_local sigjmp_buf buffer;
+    return buffer;
+  }
+
+  // only set on a thread while it runs a test
+  static volatile std::sig_atomic_t &armed() {
+    thread_local volatile std::sig_atomic_t set = false;
+    return set;
+  }
+
+  static void handler(int signal) {
+    if (armed()) {
+      siglongjmp(landing(), signal);
+    }
+    std::signal(signal, SIG_DFL);
+    std::raise(signal);
+  }
+
+  // the handlers are installed once, every thread that runs tests needs its
+  // own alternate stack
+  static void install() {
+    thread_local vector<char> stack;
+    if (stack.empty()) {
+      stack.resize(std::max<std::size_t>(SIGSTKSZ, 1 << 16));
+      stack_t alternate{};
+      alternate.ss_sp = stack.data();
+      alternate.ss_size = stack.size();
+      sigaltstack(&alternate, nullptr);
+    }
+
+    static std::once_flag installed;
+    std::call_once(installed, [] {
+      struct sigaction action {};
+      action.sa_handler = handler;
+      action.sa_flags = SA_ONSTACK;
+      sigemptyset(&action.sa_mask);
+      for (int signal : {SIGSEGV, SIGFPE, SIGBUS, SIGABRT}) {
+        sigaction(signal, &action, nullptr);
+      }
+    });
+  }
+};
+
+inline string signalName(int signal) {
+  switch (signal) {
+  case SIGSEGV:
+    return "SIGSEGV";
+  case SIGFPE:
+    return "SIGFPE";
+  case SIGBUS:
+    return "SIGBUS";
+  case SIGABRT:
+    return "SIGABRT";
+  case SIGILL:
+    return "SIGILL";
+  case SIGKILL:
+    return "SIGKILL";
+  case SIGTERM:
+    return "SIGTERM";
+  default:
+    return "signal " + std::to_string(signal);
+  }
+}
+
+// what EXPECT_EXIT expects of the wait status of its child
+struct exitpredicate {
+  template <class PREDICATE>
+  exitpredicate(PREDICATE p, string what = "a status the predicate accepts")
+      : matches(std::move(p)), description(std::move(what)) {}
+
+  std::function<bool(int)> matches;
+  string description;
+};
+
+inline string describeStatus(int status) {
+  if (WIFEXITED(status)) {
+    return "it exited with code " + std::to_string(WEXITSTATUS(status));
+  }
+  if (WIFSIGNALED(status)) {
+    return "it was killed by " + signalName(WTERMSIG(status));
+  }
+  return "it stopped";
+}
+
+// runs action in a forked child, vfork and clone(CLONE_VM) would share our
+// memory with code that is expected to die half way. The child's stderr is
+// captured, an action that returns exits with code 0.
+template <class ACTION>
+bool exits(ACTION action, std::ostream &why, const exitpredicate &expected,
+           const char *pattern = nullptr) {
+  int err[2];
+  if (pipe(err)) {
+    why << "EXPECT_EXIT could not create a pipe";
+    return false;
+  }
+  std::cout.flush();
+  std::cerr.flush();
+  std::fflush(nullptr);
+
+  const pid_t child = fork();
+  if (child == 0) {
+    dup2(err[1], STDERR_FILENO);
+    close(err[0]);
+    close(err[1]);
+    // the child's copy of a capture is never read, the streams have to reach
+    // the pipe
+    capture::current() = nullptr;
+    if (capturing *streams = capturing::active()) {
+      streams->release();
+    }
+    for (int signal : {SIGSEGV, SIGFPE, SIGBUS, SIGABRT}) {
+      std::signal(signal, SIG_DFL);
+    }
+    action();
+    std::cout.flush();
+    std::fflush(nullptr);
+    _exit(0);
+  }
+  close(err[1]);
+  if (child < 0) {
+    close(err[0]);
+    why << "EXPECT_EXIT could not fork";
+    return false;
+  }
+
+  string errors;
+  char buffer[4096];
+  ssize_t got;
+  while ((got = read(err[0], buffer, sizeof(buffer))) > 0) {
+    errors.append(buffer, got);
+  }
+  close(err[0]);
+  int status = 0;
+  waitpid(child, &status, 0);
+
+  if (!expected.matches(status)) {
+    why << "expected " << expected.description << ", "
+        << describeStatus(status);
+    return false;
+  }
+  if (pattern && !globMatch(pattern, errors.c_str())) {
+    why << "stderr doesn't match \"" << pattern << "\":\n" << errors;
+    return false;
+  }
+  return true;
+}
+
+#endif
+
+inline bool failed(const test &t) {
+  return t.failures || t.t_flawed || t.t_crashed;
+}
+
+// the worker thread or process slot running on the calling thread
+inline int &worker() {
+  thread_local int index = 0;
+  return index;
+}
+
+// measures the usage of one run of a test. Alone, the process runs nothing
+// else meanwhile: the counters of the whole process belong to the test and
+// its peak resident set is reset at the start (linux). Otherwise only the
+// counters of the calling thread are taken and the peak is unknown. An
+// inactive one measures nothing and costs nothing.
+class usagemeter {
+public:
+  usagemeter(bool active, bool alone) : _active(active), _alone(alone) {
+    if (!active) {
+      return;
+    }
+#ifdef __linux__
+    _peak = alone && resetPeak();
+#endif
+    _start = sample();
+    _began = clock::now();
+  }
+
+  usage stop() {
+    if (!_active) {
+      return {};
+    }
+    usage u = sample();
+    u.wall = nanoseconds(clock::now() - _began);
+    u.minorfaults -= _start.minorfaults;
+    u.majorfaults -= _start.majorfaults;
+    u.voluntary -= _start.voluntary;
+    u.involuntary -= _start.involuntary;
+#ifdef __linux__
+    u.peak = _peak ? peakBytes() : 0;
+#else
+    u.peak = 0;
+#endif
+    return u;
+  }
+
+private:
+  usage sample() const {
+    usage u{};
+#ifdef JTEST_POSIX
+    struct rusage r {};
+#ifdef RUSAGE_THREAD
+    getrusage(_alone ? RUSAGE_SELF : RUSAGE_THREAD, &r);
+#else
+    getrusage(RUSAGE_SELF, &r);
+#endif
+    u.minorfaults = r.ru_minflt;
+    u.majorfaults = r.ru_majflt;
+    u.voluntary = r.ru_nvcsw;
+    u.involuntary = r.ru_nivcsw;
+#endif
+    return u;
+  }
+
+#ifdef __linux__
+  // sets the peak resident set (VmHWM) back to the current one
+  static bool resetPeak() {
+    std::ofstream clear("/proc/self/clear_refs");
+    clear << "5";
+    clear.flush();
+    return clear.good();
+  }
+
+  static std::uint64_t peakBytes() {
+    std::ifstream status("/proc/self/status");
+    string line;
+    while (std::getline(status, line)) {
+      if (line.compare(0, 6, "VmHWM:") == 0) {
+        return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+      }
+    }
+    return 0;
+  }
+#endif
+
+  bool _active;
+  bool _alone;
+  bool _peak = false;
+  usage _start{};
+  clock::time_point _began;
+};
+
+// under --fail-fast, the first failure stops the run
+inline void cancel() {
+  if (settings().failfast) {
+    cancellation()->store(1);
+  }
+}
+
+// the resident set of the process in bytes, 0 if it isn't known
+inline double residentBytes() {
+#ifdef __linux__
+  std::ifstream statm("/proc/self/statm");
+  double pages = 0, resident = 0;
+  statm >> pages >> resident;
+  return resident * sysconf(_SC_PAGESIZE);
+#else
+  return 0;
+#endif
+}
+
+// the bytes malloc handed out and that weren't freed yet, 0 if it isn't known
+inline double heapBytes() {
+#ifdef JTEST_MALLINFO
+  const auto info = mallinfo2();
+  return static_cast<double>(info.uordblks + info.hblkhd);
+#else
+  return 0;
+#endif
+}
+
+// a steady increase in samples taken after every run of a soaked test, the
+// first fifth of the samples is left out while caches and pools fill up
+struct growth {
+  // bytes per run, least squares
+  double perrun;
+  // coefficient of determination, how much of the change the line explains
+  double fit;
+  // the increase the line predicts over the samples used
+  double total;
+};
+
+// stride: the number of runs between two samples
+inline growth fitGrowth(const vector<double> &samples, std::size_t stride) {
+  const std::size_t skip = samples.size() / 5;
+  const double n = samples.size() - skip;
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (std::size_t i = skip; i < samples.size(); ++i) {
+    sx += i;
+    sy += samples[i];
+    sxx += double(i) * i;
+    sxy += i * samples[i];
+  }
+  const double variance = n * sxx - sx * sx;
+  if (n < 2 || variance == 0) {
+    return {0, 0, 0};
+  }
+  const double slope = (n * sxy - sx * sy) / variance;
+  const double intercept = (sy - slope * sx) / n;
+  double residual = 0, spread = 0;
+  for (std::size_t i = skip; i < samples.size(); ++i) {
+    const double error = samples[i] - (intercept + slope * i);
+    residual += error * error;
+    spread += (samples[i] - sy / n) * (samples[i] - sy / n);
+  }
+  return {slope / stride, spread ? 1 - residual / spread : 0, slope * n};
+}
+
+// runs one test in this process, the outcome is left in t, nothing runs once
+// --fail-fast cancelled the run
+inline void runInProcess(test &t) {
+  t.t_flawed = false;
+  t.t_crashed = 0;
+  t.t_cancelled = false;
+  t.t_skipped = cancellation()->load() != 0;
+  if (t.t_skipped) {
+    return;
+  }
+  t.t_span = {};
+  t.t_span.worker = worker();
+  t.t_span.start = test::stamp();
+  // only --resource-usage and --memory-budget look at the usage
+  usagemeter meter(settings().resourceusage || settings().memorybudget,
+                   settings().jobs <= 1 || settings().zygote);
+#ifdef JTEST_POSIX
+  if (settings().recovercrashes) {
+    t.t_crashed = crashguard::run(t, t.t_flawed, t.t_cancelled);
+  } else
+#endif
+  {
+    JTEST_TRY {
+      t();
+    } JTEST_CATCH(cancelledtest &) {
+      t.t_cancelled = true;
+    } JTEST_CATCH(...) {
+      t.t_flawed = true;
+    }
+  }
+  t.t_usage = meter.stop();
+  t.t_span.end = test::stamp();
+  const std::uint64_t budget = settings().memorybudget;
+  if (budget && t.t_usage.peak > budget) {
+    ++t.failures;
+    t.note("the resident set peaked at " + formatBytes(t.t_usage.peak) +
+           ", over the budget of " + formatBytes(budget));
+  }
+  t.keepLog();
+  if (failed(t)) {
+    cancel();
+  }
+}
+
+// runs the test with its stream output going to a buffer of the calling
+// thread, reused from test to test. Only a test that didn't pass keeps it.
+inline void runCaptured(test &t) {
+  if (!settings().capture) {
+    runInProcess(t);
+    return;
+  }
+  thread_local capture buffer;
+  buffer.text.clear();
+  capture::current() = &buffer;
+  runInProcess(t);
+  capture::current() = nullptr;
+  if (failed(t)) {
+    t.t_output = buffer.text;
+  }
+}
+
+// the outcome of a test as a worker reports it, fixed size so a worker
+// process can pass it through shared memory
+struct outcome {
+  // position of the test in the run order
+  std::uint64_t index;
+  std::uint32_t failures;
+  std::int32_t flawed;
+  std::int32_t crashed;
+  std::int32_t cancelled;
+  std::int32_t skipped;
+  usage used;
+  span spanned;
+  char notes[4096];
+  // the end of what the test wrote, if it failed
+  char output[16384];
+  char log[8192];
+};
+
+inline void store(outcome &o, test &t) {
+  string notes;
+  for (auto &n : t.t_notes) {
+    notes += n + "\n";
+  }
+  if (notes.size() >= sizeof(o.notes)) {
+    notes.resize(sizeof(o.notes) - 5);
+    notes += "...";
+  }
+  std::copy(notes.begin(), notes.end(), o.notes);
+  o.notes[notes.size()] = '\0';
+  o.failures = t.failures;
+  o.flawed = t.t_flawed;
+  o.crashed = t.t_crashed;
+  o.cancelled = t.t_cancelled;
+  o.skipped = t.t_skipped;
+  o.used = t.t_usage;
+  o.spanned = t.t_span;
+
+  const std::size_t kept = std::min(t.t_output.size(), sizeof(o.output) - 1);
+  std::copy(t.t_output.end() - kept, t.t_output.end(), o.output);
+  o.output[kept] = '\0';
+
+  const std::size_t logged = std::min(t.t_log.size(), sizeof(o.log) - 1);
+  std::copy(t.t_log.end() - logged, t.t_log.end(), o.log);
+  o.log[logged] = '\0';
+}
+
+inline void load(const outcome &o, test &t) {
+  t.failures = o.failures;
+  t.t_flawed = o.flawed;
+  t.t_crashed = o.crashed;
+  t.t_cancelled = o.cancelled;
+  t.t_skipped = o.skipped;
+  t.t_usage = o.used;
+  t.t_span = o.spanned;
+  t.t_notes.clear();
+  if (o.notes[0]) {
+    t.t_notes.push_back(o.notes);
+  }
+  t.t_output = o.output;
+  t.t_log = o.log;
+}
+
+// bounded lock-free queue of records from any number of workers to the one
+// reporter. Every slot carries a sequence number that tells whose turn it is
+// (Vyukov), so producers only contend on claiming a position and never wait
+// for the reporter unless the ring is full. It holds no pointers and only
+// lock-free atomics, so it also works in memory shared between processes.
+// Worker threads share the tests and only pass their positions, worker
+// processes pass a whole outcome.
+template <class RECORD> class ring {
+public:
+  static std::size_t bytes(std::size_t slots) {
+    return sizeof(ring) + slots * sizeof(slot);
+  }
+
+  // constructs a ring with slots (a power of two) slots in memory of at
+  // least bytes(slots) bytes, aligned to 64
+  static ring *create(void *memory, std::size_t slots) {
+    ring *r = new (memory) ring(slots);
+    for (std::size_t i = 0; i < slots; ++i) {
+      new (&r->slotAt(i)) slot{};
+      r->slotAt(i).sequence.store(i, std::memory_order_relaxed);
+    }
+    return r;
+  }
+
+  void push(const RECORD &o) {
+    std::uint64_t position = _head.load(std::memory_order_relaxed);
+    for (;;) {
+      slot &s = slotAt(position & _mask);
+      const std::uint64_t sequence = s.sequence.load(std::memory_order_acquire);
+      const auto lag = static_cast<std::int64_t>(sequence - position);
+      if (lag == 0) {
+        if (_head.compare_exchange_weak(position, position + 1,
+                                        std::memory_order_relaxed)) {
+          s.record = o;
+          s.sequence.store(position + 1, std::memory_order_release);
+          return;
+        }
+      } else if (lag < 0) {
+        // full, the reporter is behind
+        std::this_thread::yield();
+        position = _head.load(std::memory_order_relaxed);
+      } else {
+        position = _head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // only ever called by the reporter
+  bool pop(RECORD &o) {
+    slot &s = slotAt(_tail & _mask);
+    if (s.sequence.load(std::memory_order_acquire) != _tail + 1) {
+      return false;
+    }
+    o = s.record;
+    s.sequence.store(_tail + _mask + 1, std::memory_order_release);
+    ++_tail;
+    return true;
+  }
+
+private:
+  struct alignas(64) slot {
+    std::atomic<std::uint64_t> sequence;
+    RECORD record;
+  };
+
+  explicit ring(std::size_t slots) : _mask(slots - 1) {}
+
+  slot &slotAt(std::size_t i) {
+    return reinterpret_cast<slot *>(this + 1)[i];
+  }
+
+  alignas(64) std::atomic<std::uint64_t> _head{0};
+  alignas(64) std::uint64_t _tail = 0;
+  std::uint64_t _mask;
+};
+
+// a ring big enough for count records, up to 1024 slots
+inline std::size_t ringSlots(std::size_t count) {
+  std::size_t slots = 1;
+  while (slots < count && slots < 1024) {
+    slots *= 2;
+  }
+  return slots;
+}
+
+// a selected test and its environment
+struct entry {
+  const string *env;
+  test *t;
+};
+
+// a claim of a test on a resource, by the index of the resource in the run
+struct claim {
+  std::uint32_t resource;
+  bool exclusive;
+  std::uint32_t limit;
+};
+
+// the claims of order[pending[i]] in claims[i], returns the number of
+// different resources
+inline std::size_t claimsOf(const vector<entry> &order,
+                            const vector<std::size_t> &pending,
+                            vector<vector<claim>> &claims) {
+  map<string, std::uint32_t> indices;
+  claims.assign(pending.size(), {});
+  if (declared().empty()) {
+    return 0;
+  }
+  for (std::size_t i = 0; i < pending.size(); ++i) {
+    const entry &e = order[pending[i]];
+    for (const string &key : {*e.env, *e.env + "." + e.t->t_name}) {
+      const auto found = declared().find(key);
+      if (found == declared().end()) {
+        continue;
+      }
+      for (const resource &r : found->second) {
+        const auto index = indices.emplace(r.name, indices.size()).first;
+        claims[i].push_back({index->second, r.exclusive, r.limit});
+      }
+    }
+  }
+  return indices.size();
+}
+
+// hands the pending tests out in run order to workers, which may be threads or
+// processes sharing the memory it lives in. A test whose resources are in use
+// is held back and the next one that fits goes out instead; without any
+// claims it is a single counter.
+class claimboard {
+public:
+  static constexpr std::size_t none = ~std::size_t(0);
+
+  static std::size_t bytes(std::size_t tests, std::size_t resources) {
+    return sizeof(claimboard) + resources * sizeof(holders) + tests;
+  }
+
+  // constructs a board in memory of at least bytes(claims.size(), resources)
+  // bytes, claims has to stay where it is while the board is used
+  static claimboard *create(void *memory, const vector<vector<claim>> &claims,
+                            std::size_t resources) {
+    claimboard *b = new (memory) claimboard(claims, resources);
+    for (std::size_t r = 0; r < resources; ++r) {
+      new (&b->holdersOf(r)) holders{};
+    }
+    std::memset(b->taken(), 0, claims.size());
+    return b;
+  }
+
+  // the next test to run, none once all are handed out, waits while every
+  // test that is left is held back
+  std::size_t take() {
+    if (!_resources) {
+      const std::size_t i = _next.fetch_add(1);
+      return i < _claims.size() ? i : none;
+    }
+    for (;;) {
+      lock();
+      std::size_t first = _next.load(std::memory_order_relaxed);
+      for (std::size_t i = first; i < _claims.size(); ++i) {
+        if (!taken()[i] && fits(_claims[i])) {
+          taken()[i] = 1;
+          for (const claim &c : _claims[i]) {
+            holders &u = holdersOf(c.resource);
+            ++u.users;
+            u.exclusive = u.exclusive || c.exclusive;
+          }
+          while (first < _claims.size() && taken()[first]) {
+            ++first;
+          }
+          _next.store(first, std::memory_order_relaxed);
+          unlock();
+          return i;
+        }
+      }
+      unlock();
+      if (first >= _claims.size()) {
+        return none;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+
+  // the test i finished, or its worker died
+  void give(std::size_t i) {
+    if (!_resources || _claims[i].empty()) {
+      return;
+    }
+    lock();
+    for (const claim &c : _claims[i]) {
+      holders &u = holdersOf(c.resource);
+      --u.users;
+      u.exclusive = u.exclusive && !c.exclusive;
+    }
+    unlock();
+  }
+
+  // every test was handed out
+  bool empty() const { return _next.load() >= _claims.size(); }
+
+private:
+  struct holders {
+    std::int32_t users;
+    bool exclusive;
+  };
+
+  claimboard(const vector<vector<claim>> &claims, std::size_t resources)
+      : _claims(claims), _resources(resources) {}
+
+  bool fits(const vector<claim> &claims) {
+    return std::all_of(claims.begin(), claims.end(), [&](const claim &c) {
+      const holders &u = holdersOf(c.resource);
+      return !u.exclusive && !(c.exclusive && u.users) &&
+             !(c.limit && u.users >= static_cast<std::int32_t>(c.limit));
+    });
+  }
+
+  // a spinning lock, a mutex can't be shared with forked workers portably
+  void lock() {
+    while (_lock.exchange(true, std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+  }
+  void unlock() { _lock.store(false, std::memory_order_release); }
+
+  holders &holdersOf(std::size_t r) {
+    return reinterpret_cast<holders *>(this + 1)[r];
+  }
+  unsigned char *taken() {
+    return reinterpret_cast<unsigned char *>(this + 1) +
+           _resources * sizeof(holders);
+  }
+
+  const vector<vector<claim>> &_claims;
+  const std::size_t _resources;
+  std::atomic<std::size_t> _next{0};
+  std::atomic<bool> _lock{false};
+};
+
+// the reported runs of the tests with --trace, written out at the end
+struct tracedtest {
+  string name;
+  const char *result;
+  span spanned;
+};
+
+inline vector<tracedtest> &traced() {
+  static vector<tracedtest> runs;
+  return runs;
+}
+
+// writes the traced runs as Chrome trace-event JSON, one row per worker with a
+// span for every test and, inside it, for its SETUP, body and TEARDOWN
+inline void writeTrace(const string &path) {
+  std::ofstream out(path);
+  if (!out) {
+    std::cout << WARNINGSTATUS << "\tcan't write the trace to " << path
+              << std::endl;
+    return;
+  }
+  std::int64_t origin = std::numeric_limits<std::int64_t>::max();
+  std::int32_t workers = 0;
+  for (auto &r : traced()) {
+    origin = std::min(origin, r.spanned.start);
+    workers = std::max(workers, r.spanned.worker + 1);
+  }
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  const char *separator = "\n";
+  auto event = [&](const string &name, const char *category,
+                   std::int64_t from, std::int64_t to, std::int32_t worker,
+                   const char *result) {
+    out << separator << "{\"name\":\"" << name << "\",\"cat\":\"" << category
+        << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << worker
+        << ",\"ts\":" << (from - origin) / 1e3
+        << ",\"dur\":" << (to - from) / 1e3;
+    if (result) {
+      out << ",\"args\":{\"result\":\"" << result << "\"}";
+    }
+    out << "}";
+    separator = ",\n";
+  };
+  out << std::fixed << std::setprecision(3);
+  for (std::int32_t w = 0; w < workers; ++w) {
+    out << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+        << "\"tid\":" << w << ",\"args\":{\"name\":\"worker " << w << "\"}}";
+    separator = ",\n";
+  }
+  for (auto &r : traced()) {
+    const span &s = r.spanned;
+    event(r.name, "test", s.start, s.end, s.worker, r.result);
+    if (s.setup) {
+      event("SETUP", "phase", s.start, s.setup, s.worker, nullptr);
+      event("body", "phase", s.setup, s.body ? s.body : s.end, s.worker,
+            nullptr);
+    }
+    if (s.body) {
+      event("TEARDOWN", "phase", s.body, s.end, s.worker, nullptr);
+    }
+  }
+  out << "\n]}\n";
+}
+
+inline const char *resultName(const test &t) {
+  if (t.t_crashed) {
+    return "crashed";
+  }
+  if (t.t_flawed) {
+    return "flawed";
+  }
+  if (t.failures) {
+    return "failed";
+  }
+  return t.t_cancelled ? "cancelled" : "passed";
+}
+
+// the line under a result with --resource-usage
+inline void printUsage(const test &t) {
+  const usage &u = t.t_usage;
+  if (!settings().resourceusage || !u.wall) {
+    return;
+  }
+  std::cout << "\t\t" << formatTime(u.wall);
+  if (u.peak) {
+    std::cout << ", peak RSS " << formatBytes(u.peak);
+  }
+  std::cout << ", " << u.minorfaults << " minor / " << u.majorfaults
+            << " major faults, " << u.voluntary << " voluntary / "
+            << u.involuntary << " involuntary switches" << std::endl;
+}
+
+// prints the outcomes in run order, one environment block at a time
+class reporter {
+public:
+  // running: a [RUNNING] line is shown while each test runs
+  explicit reporter(bool running) : _running(running) {}
+
+  void start(const entry &e) {
+    if (!_env || *_env != *e.env) {
+      close();
+      _env = e.env;
+      _failing = 0;
+      std::cout << CONSOLEMAGENTA << "STARTED:\t{ " << *_env << " }"
+                << CONSOLEDEFAULT << std::endl;
+    }
+    if (_running) {
+      std::cout << RUNNINGSTATUS << std::endl;
+    }
+  }
+
+  void finish(const entry &e) {
+    test &t = *e.t;
+    if (_running) {
+      std::cout << CONSOLECLEARLASTLINE;
+    }
+    if (!settings().trace.empty() && t.t_span.start) {
+      traced().push_back({*e.env + "." + t.t_name, resultName(t), t.t_span});
+    }
+    ++_failing;
+
+    if (t.t_crashed) {
+#ifdef JTEST_POSIX
+      std::cout << CRASHEDSTATUS;
+      t.prettyPrint();
+      std::cout << "crashed with " << signalName(t.t_crashed) << std::endl;
+      printUsage(t);
+      t.printNotes();
+      t.printLog();
+      t.printOutput();
+      if (!settings().zygote && !_corrupt) {
+        std::cout << WARNINGSTATUS
+                  << "\tthe process state may be corrupt, the results of "
+                     "the following tests are suspect"
+                  << std::endl;
+      }
+      _corrupt = true;
+      _failed = true;
+#endif
+    } else if (t.t_cancelled && !t.t_flawed && !t.failures) {
+      std::cout << CANCELLEDSTATUS;
+      t.prettyPrint();
+      std::cout << "stopped by --fail-fast" << std::endl;
+      printUsage(t);
+      t.printLog();
+      t.printOutput();
+    } else if (!t.t_flawed && !t.failures) {
+      --_failing;
+#ifdef TERSE
+      return;
+#endif
+      std::cout << PASSEDSTATUS;
+      t.prettyPrint();
+      std::cout << "all expectations were met!" << std::endl;
+      printUsage(t);
+    } else if (t.t_flawed) {
+      std::cout << FLAWEDSTATUS;
+      t.prettyPrint();
+      std::cout << "an exception was thrown and not caught" << std::endl;
+      printUsage(t);
+      t.printNotes();
+      t.printLog();
+      t.printOutput();
+      _failed = true;
+    } else {
+      std::cout << FAILEDSTATUS;
+      t.prettyPrint();
+      std::cout << t.failures << " unexpected event(s)" << std::endl;
+      printUsage(t);
+      t.printNotes();
+      t.printLog();
+      t.printOutput();
+      _failed = true;
+    }
+  }
+
+  // ends the block of the current environment
+  void close() {
+    if (!_env) {
+      return;
+    }
+#ifdef TERSE
+    if (!_failing) {
+      std::cout << TERSEP << std::endl;
+    }
+#endif
+    std::cout << std::endl;
+    _env = nullptr;
+  }
+
+  // a test that --fail-fast kept from running
+  void skip() { ++_skipped; }
+
+  bool failed() const { return _failed; }
+  std::size_t skipped() const { return _skipped; }
+
+private:
+  bool _running;
+  std::size_t _skipped = 0;
+  const string *_env = nullptr;
+  int _failing = 0;
+  bool _failed = false;
+  // a test crashed under --recover-crashes
+  bool _corrupt = false;
+};
+
+// hands the outcomes that arrive in any order to the reporter in run order
+class collector {
+public:
+  collector(const vector<entry> &order, reporter &report)
+      : _order(order), _report(report), _arrived(order.size(), false) {
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      _arrived[i] = order[i].t->t_done;
+    }
+    flush();
+  }
+
+  void arrived(std::size_t index) {
+    _arrived[index] = true;
+    flush();
+  }
+
+  bool complete() const { return _next == _order.size(); }
+
+  // true if the test at index already has its outcome
+  bool has(std::size_t index) const { return _arrived[index]; }
+
+private:
+  void flush() {
+    for (; _next < _order.size() && _arrived[_next]; ++_next) {
+      _order[_next].t->t_done = false;
+      if (_order[_next].t->t_skipped) {
+        _report.skip();
+        continue;
+      }
+      _report.start(_order[_next]);
+      _report.finish(_order[_next]);
+    }
+  }
+
+  const vector<entry> &_order;
+  reporter &_report;
+  vector<bool> _arrived;
+  std::size_t _next = 0;
+};
+
+// memory for a ring, freed when it goes out of scope
+template <class RECORD> class ringmemory {
+public:
+  explicit ringmemory(std::size_t slots)
+      : _memory(::operator new(ring<RECORD>::bytes(slots),
+                               std::align_val_t{64})),
+        _ring(ring<RECORD>::create(_memory, slots)) {}
+  ~ringmemory() { ::operator delete(_memory, std::align_val_t{64}); }
+
+  ring<RECORD> &get() { return *_ring; }
+
+private:
+  void *_memory;
+  ring<RECORD> *_ring;
+};
+
+// runs the tests of order that don't have an outcome yet on jobs threads, the
+// calling thread reports them as they finish
+inline void runThreads(const vector<entry> &order, std::size_t jobs,
+                       reporter &report) {
+  vector<std::size_t> pending;
+  for (std::size_t i = 0; i < order.size(); ++i) {
+    if (!order[i].t->t_done) {
+      pending.push_back(i);
+    }
+  }
+  ringmemory<std::uint64_t> memory(ringSlots(pending.size()));
+  ring<std::uint64_t> &results = memory.get();
+  vector<vector<claim>> claims;
+  const std::size_t resources = claimsOf(order, pending, claims);
+  vector<std::max_align_t> boardmemory(
+      claimboard::bytes(pending.size(), resources) / sizeof(std::max_align_t) +
+      1);
+  claimboard &board =
+      *claimboard::create(boardmemory.data(), claims, resources);
+
+  vector<std::thread> workers;
+  for (std::size_t w = 0; w < std::min(jobs, pending.size()); ++w) {
+    workers.emplace_back([&, w] {
+      worker() = static_cast<int>(w);
+      for (std::size_t i; (i = board.take()) != claimboard::none;) {
+        runCaptured(*order[pending[i]].t);
+        board.give(i);
+        // the test itself is shared, only its position has to travel
+        results.push(pending[i]);
+      }
+    });
+  }
+
+  collector collect(order, report);
+  std::uint64_t index;
+  while (!collect.complete()) {
+    if (results.pop(index)) {
+      collect.arrived(index);
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+  for (auto &w : workers) {
+    w.join();
+  }
+}
+
+#ifdef JTEST_POSIX
+// runs the tests of order that don't have an outcome yet in jobs worker
+// processes forked from this one, so every test starts from the state global
+// initialization left behind without paying for it again. A worker runs batch
+// tests and is replaced by a fresh fork, one that dies takes only its running
+// test with it. The outcomes come back through a ring in shared memory.
+inline void runProcesses(const vector<entry> &order, std::size_t jobs,
+                         std::size_t batch, reporter &report) {
+  vector<std::size_t> pending;
+  for (std::size_t i = 0; i < order.size(); ++i) {
+    if (!order[i].t->t_done) {
+      pending.push_back(i);
+    }
+  }
+  jobs = std::max<std::size_t>(1, std::min(jobs, pending.size()));
+
+  // the --fail-fast flag, then what every worker is running, then the board
+  // that hands out the tests, then the ring
+  vector<vector<claim>> claims;
+  const std::size_t resources = claimsOf(order, pending, claims);
+  auto aligned = [](std::size_t bytes) { return (bytes + 63) / 64 * 64; };
+  const std::size_t slots = ringSlots(pending.size());
+  const std::size_t header =
+      64 + aligned(jobs * sizeof(std::atomic<std::int64_t>));
+  const std::size_t boardbytes =
+      aligned(claimboard::bytes(pending.size(), resources));
+  const std::size_t bytes = header + boardbytes + ring<outcome>::bytes(slots);
+  void *memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    std::cout << WARNINGSTATUS
+              << "\tno shared memory for worker processes, running in process"
+              << std::endl;
+    runThreads(order, jobs, report);
+    return;
+  }
+  std::atomic<int> *const local = cancellation();
+  cancellation() = new (memory) std::atomic<int>(local->load());
+  auto *running = reinterpret_cast<std::atomic<std::int64_t> *>(
+      static_cast<char *>(memory) + 64);
+  for (std::size_t w = 0; w < jobs; ++w) {
+    new (&running[w]) std::atomic<std::int64_t>(-1);
+  }
+  claimboard &board = *claimboard::create(static_cast<char *>(memory) + header,
+                                          claims, resources);
+  ring<outcome> &results = *ring<outcome>::create(
+      static_cast<char *>(memory) + header + boardbytes, slots);
+
+  // every worker slot writes its stdout and stderr to a file of its own, which
+  // the parent can still read when the worker died
+  vector<FILE *> captures(jobs, nullptr);
+  for (auto &c : captures) {
+    c = tmpfile();
+  }
+  auto captured = [&](std::size_t w) {
+    string text;
+    char buffer[4096];
+    ssize_t got;
+    for (off_t at = 0;
+         (got = pread(fileno(captures[w]), buffer, sizeof(buffer), at)) > 0;
+         at += got) {
+      text.append(buffer, got);
+    }
+    return text;
+  };
+
+  auto work = [&](std::size_t w) {
+    worker() = static_cast<int>(w);
+    outcome o{};
+    if (captures[w]) {
+      dup2(fileno(captures[w]), STDOUT_FILENO);
+      dup2(fileno(captures[w]), STDERR_FILENO);
+      // a file is fully buffered, a test that crashes would lose what it wrote
+      setvbuf(stdout, nullptr, _IONBF, 0);
+    }
+    for (std::size_t ran = 0; ran < batch; ++ran) {
+      const std::size_t i = board.take();
+      if (i == claimboard::none) {
+        break;
+      }
+      running[w].store(static_cast<std::int64_t>(i));
+      test &t = *order[pending[i]].t;
+      if (captures[w]) {
+        ftruncate(fileno(captures[w]), 0);
+        lseek(STDOUT_FILENO, 0, SEEK_SET);
+      }
+      runInProcess(t);
+      std::cout.flush();
+      std::cerr.flush();
+      std::fflush(nullptr);
+      if (captures[w] && failed(t)) {
+        t.t_output = captured(w);
+      }
+      store(o, t);
+      o.index = pending[i];
+      results.push(o);
+      board.give(i);
+      running[w].store(-1);
+    }
+    std::cout.flush();
+    std::fflush(nullptr);
+    _exit(0);
+  };
+
+  vector<pid_t> workers(jobs, 0);
+  auto spawn = [&](std::size_t w) {
+    std::cout.flush();
+    std::fflush(nullptr);
+    workers[w] = fork();
+    if (workers[w] == 0) {
+      work(w);
+    }
+  };
+  for (std::size_t w = 0; w < jobs; ++w) {
+    spawn(w);
+  }
+
+  collector collect(order, report);
+  outcome o{};
+  auto drain = [&] {
+    bool any = false;
+    while (results.pop(o)) {
+      load(o, *order[o.index].t);
+      collect.arrived(o.index);
+      any = true;
+    }
+    return any;
+  };
+  while (!collect.complete()) {
+    bool progress = drain();
+    int status = 0;
+    const pid_t ended = waitpid(-1, &status, WNOHANG);
+    const auto w = std::find(workers.begin(), workers.end(), ended);
+    if (ended > 0 && w != workers.end()) {
+      progress = true;
+      drain();
+      const std::size_t slot = w - workers.begin();
+      const std::int64_t taken = running[slot].exchange(-1);
+      if (taken >= 0 && !collect.has(pending[taken])) {
+        const std::size_t lost = pending[taken];
+        board.give(taken);
+        test &t = *order[lost].t;
+        if (WIFSIGNALED(status)) {
+          t.t_crashed = WTERMSIG(status);
+        } else {
+          t.t_flawed = true;
+          t.note("the process running the test ended early, " +
+                 describeStatus(status));
+        }
+        cancel();
+        if (captures[slot]) {
+          t.t_output = captured(slot);
+        }
+        collect.arrived(lost);
+      }
+      *w = 0;
+      if (!board.empty()) {
+        spawn(slot);
+      }
+    }
+    if (std::find(workers.begin(), workers.end(), -1) != workers.end()) {
+      // fork failed, whatever is left runs here
+      std::cout << WARNINGSTATUS
+                << "\tcould not fork a worker process, running in process"
+                << std::endl;
+      std::replace(workers.begin(), workers.end(), -1, 0);
+      for (std::size_t i; (i = board.take()) != claimboard::none;) {
+        runInProcess(*order[pending[i]].t);
+        board.give(i);
+        collect.arrived(pending[i]);
+      }
+    }
+    if (!progress) {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  }
+  for (pid_t w : workers) {
+    if (w > 0) {
+      waitpid(w, nullptr, 0);
+    }
+  }
+  for (FILE *c : captures) {
+    if (c) {
+      fclose(c);
+    }
+  }
+  local->store(cancellation()->load());
+  cancellation() = local;
+  munmap(memory, bytes);
+}
+#endif
+
+}; // namespace internal
+
+// true once --fail-fast stopped the run, for the threads a test starts and for
+// long loops that should give up early
+inline bool cancelled() {
+  return internal::cancellation()->load(std::memory_order_relaxed) != 0;
+}
+
+#ifdef JTEST_COROUTINES
+template <class T = void> class task;
+
+namespace internal {
+
+struct promisebase {
+  struct finalawaiter {
+    bool await_ready() noexcept { return false; }
+    template <class P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+      auto &p = h.promise();
+      if (p.continuation) {
+        return p.continuation;
+      }
+      if (p.finished) {
+        *p.finished = true;
+      }
+      return std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  finalawaiter final_suspend() noexcept { return {}; }
+  void unhandled_exception() { thrown = std::current_exception(); }
+
+  // the coroutine awaiting this one
+  std::coroutine_handle<> continuation;
+  // set when a top level task is done
+  bool *finished = nullptr;
+  std::exception_ptr thrown;
+};
+
+template <class T> struct promise : promisebase {
+  task<T> get_return_object();
+  void return_value(T value) { result.emplace(std::move(value)); }
+  std::optional<T> result;
+};
+
+template <> struct promise<void> : promisebase {
+  task<void> get_return_object();
+  void return_void() {}
+};
+
+} // namespace internal
+
+// a lazily started coroutine, the body of a JTEST_ASYNC and of any async helper
+// it co_awaits
+template <class T> class task {
+public:
+  using promise_type = internal::promise<T>;
+
+  explicit task(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+  task(task &&other) noexcept : _handle(std::exchange(other._handle, {})) {}
+  task &operator=(task &&other) noexcept {
+    std::swap(_handle, other._handle);
+    return *this;
+  }
+  ~task() {
+    if (_handle) {
+      _handle.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+    _handle.promise().continuation = awaiting;
+    return _handle;
+  }
+  T await_resume() {
+    auto &p = _handle.promise();
+    if (p.thrown) {
+      std::rethrow_exception(p.thrown);
+    }
+    if constexpr (!std::is_void<T>::value) {
+      return std::move(*p.result);
+    }
+  }
+
+  // runs a top level task until its first suspension, finished is set once it
+  // is done
+  void start(bool &finished) {
+    _handle.promise().finished = &finished;
+    _handle.resume();
+  }
+
+  std::exception_ptr thrown() const { return _handle.promise().thrown; }
+
+private:
+  std::coroutine_handle<promise_type> _handle;
+};
+
+namespace internal {
+
+template <class T> task<T> promise<T>::get_return_object() {
+  return task<T>{std::coroutine_handle<promise<T>>::from_promise(*this)};
+}
+
+inline task<void> promise<void>::get_return_object() {
+  return task<void>{std::coroutine_handle<promise<void>>::from_promise(*this)};
+}
+
+// one thread, one epoll instance and a timer queue that every JTEST_ASYNC test
+// is multiplexed on, a test is done when its task finishes
+class eventloop {
+public:
+  static eventloop &instance() {
+    static eventloop loop{};
+    return loop;
+  }
+
+  void start(test &t, task<> body, std::function<void()> teardown) {
+    _runs.push_back(asyncrun{&t, std::move(body), std::move(teardown), false});
+    asyncrun &r = _runs.back();
+    test::current() = r.t;
+    r.body.start(r.finished);
+  }
+
+  // resumes the waiting coroutines until every test finished or none of them
+  // can make progress any more, returns the tests that never finished
+  vector<test *> run() {
+    epoll_event events[64];
+    for (;;) {
+      reap();
+      if (_runs.empty()) {
+        return {};
+      }
+      if (_timers.empty() && _fds.empty()) {
+        break;
+      }
+
+      int timeout = -1;
+      if (!_timers.empty()) {
+        const auto wait = _timers.begin()->first - clock::now();
+        timeout = static_cast<int>(std::max<long long>(
+            0, std::chrono::ceil<std::chrono::milliseconds>(wait).count()));
+      }
+      const int ready =
+          epoll_wait(_epoll, events, 64, _fds.empty() ? 0 : timeout);
+      if (_fds.empty() && timeout > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+      }
+      for (int i = 0; i < ready; ++i) {
+        wake(events[i].data.fd, events[i].events);
+      }
+
+      const auto now = clock::now();
+      while (!_timers.empty() && _timers.begin()->first <= now) {
+        const waiter w = _timers.begin()->second;
+        _timers.erase(_timers.begin());
+        resume(w);
+      }
+    }
+
+    vector<test *> stuck;
+    for (auto &r : _runs) {
+      r.teardown();
+      stuck.push_back(r.t);
+    }
+    _runs.clear();
+    return stuck;
+  }
+
+  void sleepUntil(clock::time_point deadline, std::coroutine_handle<> h) {
+    _timers.emplace(deadline, waiter{h, test::current()});
+  }
+
+  void waitFor(int fd, std::uint32_t event, std::coroutine_handle<> h) {
+    const bool known = _fds.count(fd) != 0;
+    fdwaiters &f = _fds[fd];
+    (event == EPOLLIN ? f.reader : f.writer) = waiter{h, test::current()};
+    epoll_event e = interest(fd, f);
+    epoll_ctl(_epoll, known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &e);
+  }
+
+private:
+  eventloop() : _epoll(epoll_create1(EPOLL_CLOEXEC)) {}
+  ~eventloop() { close(_epoll); }
+
+  struct asyncrun {
+    test *t;
+    task<> body;
+    std::function<void()> teardown;
+    bool finished;
+  };
+
+  struct waiter {
+    std::coroutine_handle<> handle;
+    test *t;
+  };
+
+  struct fdwaiters {
+    waiter reader{};
+    waiter writer{};
+  };
+
+  static epoll_event interest(int fd, const fdwaiters &f) {
+    epoll_event e{};
+    if (f.reader.handle) {
+      e.events |= EPOLLIN;
+    }
+    if (f.writer.handle) {
+      e.events |= EPOLLOUT;
+    }
+    e.data.fd = fd;
+    return e;
+  }
+
+  void resume(const waiter &w) {
+    test::current() = w.t;
+    w.handle.resume();
+  }
+
+  void wake(int fd, std::uint32_t events) {
+    fdwaiters f = _fds[fd];
+    const bool errors = events & (EPOLLERR | EPOLLHUP);
+    fdwaiters left{};
+    if (f.reader.handle && !(events & EPOLLIN) && !errors) {
+      left.reader = f.reader;
+    }
+    if (f.writer.handle && !(events & EPOLLOUT) && !errors) {
+      left.writer = f.writer;
+    }
+    if (left.reader.handle || left.writer.handle) {
+      _fds[fd] = left;
+      epoll_event e = interest(fd, left);
+      epoll_ctl(_epoll, EPOLL_CTL_MOD, fd, &e);
+    } else {
+      _fds.erase(fd);
+      epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    if (f.reader.handle && !left.reader.handle) {
+      resume(f.reader);
+    }
+    if (f.writer.handle && !left.writer.handle) {
+      resume(f.writer);
+    }
+  }
+
+  // tears down the environments of the finished tests
+  void reap() {
+    for (auto r = _runs.begin(); r != _runs.end();) {
+      if (r->finished) {
+        if (r->body.thrown()) {
+          r->t->t_flawed = true;
+        }
+        r->teardown();
+        r = _runs.erase(r);
+      } else {
+        ++r;
+      }
+    }
+  }
+
+  int _epoll;
+  list<asyncrun> _runs;
+  std::multimap<clock::time_point, waiter> _timers;
+  map<int, fdwaiters> _fds;
+};
+
+struct timerawaiter {
+  clock::time_point deadline;
+  bool await_ready() const { return clock::now() >= deadline; }
+  void await_suspend(std::coroutine_handle<> h) {
+    eventloop::instance().sleepUntil(deadline, h);
+  }
+  void await_resume() {}
+};
+
+struct fdawaiter {
+  int fd;
+  std::uint32_t event;
+  bool await_ready() const { return false; }
+  void await_suspend(std::coroutine_handle<> h) {
+    eventloop::instance().waitFor(fd, event, h);
+  }
+  void await_resume() {}
+};
+
+} // namespace internal
+
+// co_await inside a JTEST_ASYNC: resumes after the given duration
+template <class REP, class PERIOD>
+internal::timerawaiter sleepFor(std::chrono::duration<REP, PERIOD> duration) {
+  return {internal::clock::now() +
+          std::chrono::duration_cast<internal::clock::duration>(duration)};
+}
+
+// co_await inside a JTEST_ASYNC: resumes once fd can be read from
+inline internal::fdawaiter readable(int fd) { return {fd, EPOLLIN}; }
+
+// co_await inside a JTEST_ASYNC: resumes once fd can be written to
+inline internal::fdawaiter writable(int fd) { return {fd, EPOLLOUT}; }
+#endif
+
+class TestRegister {
+public:
+  static bool registerTest(string &&envname, internal::test &&t) {
+    auto &_tests = getInstance()._tests;
+    auto _testiter = _tests.find(envname);
+    if (_testiter == _tests.end()) {
+      _tests[envname] = list{t};
+    } else {
+      (*_testiter).second.push_back(t);
+    }
+    return true;
+  }
+
+  static bool registerBench(string &&envname, internal::bench &&b) {
+    auto &_benches = getInstance()._benches;
+    auto _benchiter = _benches.find(envname);
+    if (_benchiter == _benches.end()) {
+      _benches[envname] = list{b};
+    } else {
+      (*_benchiter).second.push_back(b);
+    }
+    return true;
+  }
+
+  static void _dump() {
+    auto &_tests = getInstance()._tests;
+    for (auto &p : _tests) {
+      std::cout << "ENV:\t" << p.first << std::endl;
+      for (auto &t : p.second) {
+        std::cout << "TEST:\t" << t.t_name << t.failures << std::endl;
+      }
+    }
+  }
+
+  static int runAllTests() {
+    auto &settings = internal::settings();
+    vector<internal::entry> tests;
+    for (auto &p_envtestlist : getInstance()._tests) {
+      for (auto &t : p_envtestlist.second) {
+        if (!settings.benchonly &&
+            internal::selected(p_envtestlist.first, t.t_name)) {
+          tests.push_back({&p_envtestlist.first, &t});
+        }
+      }
+    }
+
+    const std::uint64_t seed =
+        settings.seed ? settings.seed : std::random_device{}();
+    std::mt19937_64 rng(seed);
+    if (settings.shuffle) {
+      std::cout << CONSOLEMAGENTA << "SHUFFLED:\t--seed=" << seed
+                << CONSOLEDEFAULT << std::endl
+                << std::endl;
+    }
+    if (!settings.runorder.empty() || !settings.bisect.empty()) {
+      // both work on the order of the first round
+      if (settings.shuffle) {
+        std::shuffle(tests.begin(), tests.end(), rng);
+      }
+      const bool shuffled = settings.shuffle;
+      settings.shuffle = false;
+      if (!settings.runorder.empty()) {
+        vector<internal::entry> picked;
+        for (int i : internal::parseCpuList(settings.runorder)) {
+          if (i >= 0 && std::size_t(i) < tests.size()) {
+            picked.push_back(tests[i]);
+          }
+        }
+        tests = picked;
+      }
+#ifdef JTEST_POSIX
+      if (!settings.bisect.empty()) {
+        return bisectPollution(tests, shuffled ? seed : 0);
+      }
+#else
+      (void)shuffled;
+#endif
+    }
+    if (settings.soak.count()) {
+      return soakAllTests(tests);
+    }
+    // --until-fail is --fail-fast over as many rounds as it takes
+    settings.failfast = settings.failfast || settings.untilfail;
+    // without tests nothing could ever stop --until-fail
+    std::size_t rounds = settings.untilfail ? std::size_t(-1) : 1;
+    if (settings.repeat) {
+      rounds = settings.repeat;
+    }
+    if (tests.empty()) {
+      rounds = 0;
+    }
+
+    const bool parallel = settings.jobs > 1 || settings.zygote;
+    if (settings.memorybudget && settings.jobs > 1 && !settings.zygote) {
+      std::cout << WARNINGSTATUS
+                << "\t--memory-budget needs one test per process at a time, "
+                   "it is ignored on worker threads (use --zygote)"
+                << std::endl
+                << std::endl;
+    }
+    settings.capture = settings.capture || parallel;
+    // worker processes capture at the file descriptors instead
+    std::unique_ptr<internal::capturing> capturing;
+    if (settings.capture && !settings.zygote) {
+      capturing.reset(new internal::capturing());
+    }
+    internal::reporter report(!parallel);
+
+    // repeated rounds run on copies of the tests, a few rounds at a time so
+    // the workers have enough to do, and --until-fail checks in between
+    const std::size_t size = std::max<std::size_t>(1, tests.size());
+    std::size_t perchunk = (std::size_t(1) << 16) / size;
+    if (settings.untilfail) {
+      perchunk = parallel ? settings.jobs * 16 / size : 1;
+    }
+    perchunk = std::max<std::size_t>(1, perchunk);
+    map<const internal::test *, std::pair<std::size_t, std::size_t>> runs;
+    for (std::size_t round = 0; round < rounds && !JTest::cancelled();) {
+      const std::size_t chunk =
+          rounds == 1 ? 1 : std::min(perchunk, rounds - round);
+      vector<internal::entry> order;
+      list<internal::test> copies;
+      vector<const internal::test *> originals;
+      for (std::size_t r = 0; r < chunk; ++r) {
+        vector<internal::entry> shuffled = tests;
+        if (settings.shuffle) {
+          std::shuffle(shuffled.begin(), shuffled.end(), rng);
+        }
+        for (auto &e : shuffled) {
+          originals.push_back(e.t);
+          if (rounds > 1) {
+            copies.push_back(*e.t);
+            order.push_back({e.env, &copies.back()});
+          } else {
+            order.push_back(e);
+          }
+        }
+      }
+      runRound(order, parallel, report);
+      for (std::size_t i = 0; i < order.size(); ++i) {
+        auto &counts = runs[originals[i]];
+        counts.first += !order[i].t->t_skipped;
+        counts.second += internal::failed(*order[i].t);
+      }
+      round += chunk;
+    }
+    report.close();
+    if (!settings.trace.empty()) {
+      internal::writeTrace(settings.trace);
+    }
+    bool completefail = report.failed();
+    if (report.skipped()) {
+      std::cout << WARNINGSTATUS << "\tskipped " << report.skipped()
+                << " test(s) after the first failure" << std::endl
+                << std::endl;
+    }
+    if (rounds > 1) {
+      for (auto &e : tests) {
+        const auto &counts = runs[e.t];
+        if (counts.second) {
+          std::cout << WARNINGSTATUS << "\t" << *e.env << "." << e.t->t_name
+                    << " failed " << counts.second << " of " << counts.first
+                    << " runs" << std::endl;
+        }
+      }
+    }
+#ifdef JTEST_POSIX
+    if (settings.testrecords) {
+      for (auto &e : tests) {
+        std::cout << "JTESTRECORD\t" << *e.env << "\t" << e.t->t_name << "\t"
+                  << (runs[e.t].second ? "failed" : "passed") << std::endl;
+      }
+      return completefail;
+    }
+    if (settings.retries && completefail) {
+      // the retries only clear the tests they ran, those skipped after the
+      // first failure never ran at all
+      const bool consistent = retryFailed(tests, runs);
+      completefail = consistent || report.skipped() || JTest::cancelled();
+    }
+#endif
+    if (settings.shuffle && completefail) {
+      std::cout << WARNINGSTATUS << "\treplay this order with --shuffle --seed="
+                << seed << std::endl
+                << std::endl;
+    }
+
+    // a cancelled run stops before the benchmarks, their EXPECT_*s would
+    // throw out of them
+    if (JTest::cancelled()) {
+      bool benches = false;
+      for (auto &p : getInstance()._benches) {
+        for (auto &b : p.second) {
+          benches = benches || internal::selected(p.first, b.b_name);
+        }
+      }
+      if (benches) {
+        std::cout << WARNINGSTATUS
+                  << "\tskipped the benchmarks after the first failure"
+                  << std::endl
+                  << std::endl;
+      }
+    } else if (runAllBenchmarks()) {
+      completefail = true;
+    }
+
+    std::cout << (completefail ? COMPLETEF : COMPLETEP) << std::endl;
+    return completefail;
+  }
+
+private:
+  // gives every selected test an equal share of --soak and runs it over and
+  // over in this process for that long, sampling the resident set and the
+  // heap in use after every run. A test fails if it fails in any run, or if
+  // either grows steadily: a line fits the samples (r^2 >= 0.5) and predicts
+  // at least 16 KiB of heap or 1 MiB of resident set more by the end.
+  static bool soakAllTests(const vector<internal::entry> &tests) {
+    auto &settings = internal::settings();
+    settings.capture = true;
+    internal::capturing capturing;
+    vector<const internal::entry *> soaked;
+    for (auto &e : tests) {
+      if (!e.t->t_async) {
+        soaked.push_back(&e);
+      }
+    }
+    if (soaked.empty()) {
+      return false;
+    }
+    const auto share = settings.soak / soaked.size();
+    std::cout << CONSOLEMAGENTA << "SOAKING:\t{ " << soaked.size()
+              << " test(s), " << internal::formatTime(share.count())
+              << " each }" << CONSOLEDEFAULT << std::endl
+              << std::endl;
+    auto steadily = [](const char *what, const internal::growth &g) {
+      std::ostringstream out;
+      out << "\t\t" << what << " grows steadily (r^2 " << std::fixed
+          << std::setprecision(2) << g.fit << "), "
+          << internal::formatBytes(g.total) << " more by the end";
+      return out.str();
+    };
+    auto perrun = [](double bytes) {
+      return (bytes < 0 ? "-" : "+") + internal::formatBytes(std::abs(bytes)) +
+             "/run";
+    };
+
+    internal::reporter report(false);
+    bool soakfail = false;
+    for (const internal::entry *e : soaked) {
+      internal::test &t = *e->t;
+      report.start(*e);
+      // a sample every stride runs, in buffers that never grow: once they are
+      // full every other sample goes and the stride doubles
+      const std::size_t capacity = 4096;
+      vector<double> resident, heap;
+      resident.reserve(capacity);
+      heap.reserve(capacity);
+      std::size_t runs = 0, stride = 1;
+      const auto deadline = internal::clock::now() + share;
+      do {
+        internal::runCaptured(t);
+        if (++runs % stride) {
+          continue;
+        }
+        if (heap.size() == capacity) {
+          for (std::size_t i = 0; i < capacity / 2; ++i) {
+            resident[i] = resident[2 * i + 1];
+            heap[i] = heap[2 * i + 1];
+          }
+          resident.resize(capacity / 2);
+          heap.resize(capacity / 2);
+          stride *= 2;
+        }
+        resident.push_back(internal::residentBytes());
+        heap.push_back(internal::heapBytes());
+      } while (!internal::failed(t) && internal::clock::now() < deadline);
+
+      if (internal::failed(t)) {
+        std::cout << FAILEDSTATUS;
+        t.prettyPrint();
+        std::cout << "failed in run " << runs << std::endl;
+        t.printNotes();
+        t.printLog();
+        t.printOutput();
+        soakfail = true;
+        continue;
+      }
+      const internal::growth h = internal::fitGrowth(heap, stride);
+      const internal::growth r = internal::fitGrowth(resident, stride);
+      const bool heapgrows = h.fit >= 0.5 && h.total >= 16 << 10;
+      const bool residentgrows = r.fit >= 0.5 && r.total >= 1 << 20;
+      std::cout << (heapgrows || residentgrows ? GROWINGSTATUS : PASSEDSTATUS);
+      t.prettyPrint();
+      std::cout << runs << " runs, heap " << perrun(h.perrun)
+                << ", RSS " << perrun(r.perrun) << std::endl;
+      if (runs < 10) {
+        std::cout << "\t\ttoo few runs to tell a trend, soak longer"
+                  << std::endl;
+      }
+      if (heapgrows) {
+        std::cout << steadily("the heap in use", h) << std::endl;
+      }
+      if (residentgrows) {
+        std::cout << steadily("the resident set", r) << std::endl;
+      }
+      soakfail = soakfail || heapgrows || residentgrows;
+    }
+    report.close();
+    std::cout << (soakfail ? COMPLETEF : COMPLETEP) << std::endl;
+    return soakfail;
+  }
+
+  // runs the tests of order once, in the order given
+  static void runRound(const vector<internal::entry> &order, bool parallel,
+                       internal::reporter &report) {
+    auto &settings = internal::settings();
+#ifdef JTEST_COROUTINES
+    runAsyncTests(order);
+#endif
+    if (!parallel) {
+      for (auto &e : order) {
+        if (!e.t->t_done && JTest::cancelled()) {
+          e.t->t_skipped = true;
+          report.skip();
+          continue;
+        }
+        report.start(e);
+        if (!e.t->t_done) {
+          internal::runCaptured(*e.t);
+        }
+        e.t->t_done = false;
+        report.finish(e);
+      }
+#ifdef JTEST_POSIX
+    } else if (settings.zygote) {
+      internal::runProcesses(order, settings.jobs, settings.zygote, report);
+#endif
+    } else {
+      internal::runThreads(order, settings.jobs, report);
+    }
+  }
+
+#ifdef JTEST_COROUTINES
+  // starts every selected JTEST_ASYNC test and runs the event loop until all of
+  // them finished, so they take as long as the slowest one instead of the sum
+  static void runAsyncTests(const vector<internal::entry> &order) {
+    vector<internal::test *> started;
+    for (auto &e : order) {
+      internal::test &t = *e.t;
+      if (!t.t_async) {
+        continue;
+      }
+      t.begin();
+      t.t_done = true;
+      started.push_back(&t);
+      JTEST_TRY {
+        t.t_func(t);
+      } JTEST_CATCH(...) {
+        t.t_flawed = true;
+      }
+    }
+    if (started.empty()) {
+      return;
+    }
+    for (internal::test *t : internal::eventloop::instance().run()) {
+      t->t_flawed = true;
+      t->note("the test was still waiting when nothing could wake it up");
+    }
+    for (auto t = started.rbegin(); t != started.rend(); ++t) {
+      (*t)->end();
+      (*t)->keepLog();
+      if (internal::failed(**t)) {
+        internal::cancel();
+      }
+    }
+  }
+#endif
+
+  static bool runAllBenchmarks() {
+    auto &_benches = getInstance()._benches;
+    auto &settings = internal::settings();
+    bool benchfail = false;
+    if (settings.benchrecords) {
+      return recordAllBenchmarks();
+    }
+    if (!_benches.empty()) {
+      internal::benchEnvironment(true);
+    }
+#ifdef JTEST_POSIX
+    if (settings.benchprocesses) {
+      rerunAllBenchmarks();
+    }
+#else
+    if (settings.benchprocesses) {
+      std::cout << WARNINGSTATUS
+                << "\tbenchmark reruns need fork, running in this process"
+                << std::endl;
+    }
+#endif
+    for (auto &p_envbenchlist : _benches) {
+      if (std::none_of(p_envbenchlist.second.begin(),
+                       p_envbenchlist.second.end(), [&](internal::bench &b) {
+                         return internal::selected(p_envbenchlist.first,
+                                                   b.b_name);
+                       })) {
+        continue;
+      }
+      std::cout << CONSOLEMAGENTA << "BENCHMARK:\t{ " << p_envbenchlist.first
+                << " }" << CONSOLEDEFAULT << std::endl;
+
+      for (auto &b : p_envbenchlist.second) {
+        if (!internal::selected(p_envbenchlist.first, b.b_name)) {
+          continue;
+        }
+        bool flawed = b.b_flawed;
+
+        if (!b.b_done) {
+          std::cout << RUNNINGSTATUS << std::endl;
+
+          JTEST_TRY {
+            b();
+          } JTEST_CATCH(...) {
+            flawed = true;
+          }
+
+          std::cout << CONSOLECLEARLASTLINE;
+        }
+
+        if (flawed) {
+          std::cout << FLAWEDSTATUS;
+          b.prettyPrint();
+          std::cout << "an exception was thrown and not caught" << std::endl;
+          benchfail = true;
+        } else if (b.b_ctx.failures) {
+          std::cout << FAILEDSTATUS;
+          b.prettyPrint();
+          std::cout << b.b_ctx.failures << " unexpected event(s)" << std::endl;
+          b.b_ctx.printNotes();
+          for (auto &note : b.b_notes) {
+            std::cout << "\t\t" << note << std::endl;
+          }
+          benchfail = true;
+        } else {
+          std::cout << BENCHSTATUS;
+          b.prettyPrint();
+          std::cout << std::endl;
+          b.b_table.print();
+          for (auto &note : b.b_notes) {
+            std::cout << "\t\t" << note << std::endl;
+          }
+        }
+      }
+      std::cout << std::endl;
+    }
+    return benchfail;
+  }
+
+  // runs the selected benchmarks and prints one line per result, the format
+  // read back by rerunAllBenchmarks
+  static bool recordAllBenchmarks() {
+    bool benchfail = false;
+    for (auto &p_envbenchlist : getInstance()._benches) {
+      for (auto &b : p_envbenchlist.second) {
+        if (!internal::selected(p_envbenchlist.first, b.b_name)) {
+          continue;
+        }
+        bool flawed = false;
+        JTEST_TRY {
+          b();
+        } JTEST_CATCH(...) {
+          flawed = true;
+        }
+        if (flawed || b.b_ctx.failures) {
+          std::cout << "JBENCHFAILED\t" << p_envbenchlist.first << "\t"
+                    << b.b_name << "\t" << (flawed ? "flawed" : "failed")
+                    << "\t" << b.b_ctx.failures << std::endl;
+          benchfail = true;
+          continue;
+        }
+        for (auto &r : b.b_results) {
+          std::cout << "JBENCHRECORD\t" << p_envbenchlist.first << "\t"
+                    << b.b_name << "\t" << b.b_column << "\t" << r.first
+                    << "\t" << std::setprecision(17) << r.second << std::endl;
+        }
+      }
+    }
+    return benchfail;
+  }
+
+#ifdef JTEST_POSIX
+  // reruns every test that failed --retries times, each time alone in a fresh
+  // process, up to --jobs at once. A test that fails every time fails the run,
+  // one that passes at least once is reported as flaky.
+  static bool retryFailed(
+      const vector<internal::entry> &tests,
+      map<const internal::test *, std::pair<std::size_t, std::size_t>> &runs) {
+    auto &settings = internal::settings();
+    vector<string> common =
+        internal::rerunArguments({"--filter", "--shuffle", "--seed"});
+    common.push_back("--test-records");
+
+    vector<const internal::entry *> failed;
+    for (auto &e : tests) {
+      if (runs[e.t].second) {
+        failed.push_back(&e);
+      }
+    }
+    const std::size_t attempts = failed.size() * settings.retries;
+    vector<std::size_t> passed(failed.size(), 0);
+    std::mutex lock;
+    std::atomic<std::size_t> next{0};
+    auto retry = [&] {
+      for (std::size_t i; (i = next.fetch_add(1)) < attempts;) {
+        const internal::entry &e = *failed[i / settings.retries];
+        vector<string> arguments = common;
+        arguments.push_back("--filter=" + *e.env + "." + e.t->t_name);
+        const string record = "JTESTRECORD\t" + *e.env + "\t" +
+                              e.t->t_name + "\tpassed\n";
+        if (internal::runSelf(arguments).find(record) != string::npos) {
+          std::lock_guard<std::mutex> guard{lock};
+          ++passed[i / settings.retries];
+        }
+      }
+    };
+    std::cout << CONSOLEMAGENTA << "RETRIED:\t{ " << failed.size()
+              << " failed test(s), " << settings.retries
+              << " time(s) each in a fresh process }" << CONSOLEDEFAULT
+              << std::endl;
+    vector<std::thread> workers;
+    for (std::size_t w = 1; w < std::min(settings.jobs, attempts); ++w) {
+      workers.emplace_back(retry);
+    }
+    retry();
+    for (auto &w : workers) {
+      w.join();
+    }
+
+    bool consistent = false;
+    for (std::size_t i = 0; i < failed.size(); ++i) {
+      std::cout << (passed[i] ? FLAKYSTATUS : FAILEDSTATUS) << "\t"
+                << CONSOLEBLUE << *failed[i]->env << "." << failed[i]->t->t_name
+                << CONSOLEDEFAULT << ": passed " << passed[i] << " of "
+                << settings.retries << " retries"
+                << (passed[i] ? "" : ", fails consistently") << std::endl;
+      consistent = consistent || !passed[i];
+    }
+    std::cout << std::endl;
+    return consistent;
+  }
+
+  // finds a smallest set of the tests that run before --bisect-pollution whose
+  // side effects make it fail: every candidate set is replayed in a fresh
+  // process, in run order and followed by the test, up to --jobs at once, and
+  // the sets shrink by delta debugging
+  static bool bisectPollution(const vector<internal::entry> &order,
+                              std::uint64_t seed) {
+    auto &settings = internal::settings();
+    const auto target =
+        std::find_if(order.begin(), order.end(), [&](auto &e) {
+          return *e.env + "." + e.t->t_name == settings.bisect;
+        });
+    if (target == order.end()) {
+      std::cout << WARNINGSTATUS << "\tno selected test is called "
+                << settings.bisect << std::endl;
+      return true;
+    }
+    const std::size_t at = target - order.begin();
+    vector<string> common = internal::rerunArguments({"--shuffle", "--seed"});
+    common.push_back("--test-records");
+    if (seed) {
+      common.push_back("--shuffle");
+      common.push_back("--seed=" + std::to_string(seed));
+    }
+    const string passed = "JTESTRECORD\t" + *target->env + "\t" +
+                          target->t->t_name + "\tpassed\n";
+    auto replay = [&](vector<std::size_t> before) {
+      before.push_back(at);
+      return "--run-order=" + internal::formatList(before);
+    };
+
+    // true for every candidate after which the test fails
+    auto fail = [&](const vector<vector<std::size_t>> &candidates) {
+      vector<char> failed(candidates.size(), 0);
+      std::atomic<std::size_t> next{0};
+      auto check = [&] {
+        for (std::size_t i; (i = next.fetch_add(1)) < candidates.size();) {
+          vector<string> arguments = common;
+          arguments.push_back(replay(candidates[i]));
+          failed[i] =
+              internal::runSelf(arguments).find(passed) == string::npos;
+        }
+      };
+      vector<std::thread> workers;
+      for (std::size_t w = 1; w < std::min(settings.jobs, candidates.size());
+           ++w) {
+        workers.emplace_back(check);
+      }
+      check();
+      for (auto &w : workers) {
+        w.join();
+      }
+      return failed;
+    };
+
+    vector<std::size_t> blamed(at);
+    for (std::size_t i = 0; i < at; ++i) {
+      blamed[i] = i;
+    }
+    std::cout << CONSOLEMAGENTA << "BISECTING:\t{ " << settings.bisect << ", "
+              << at << " test(s) run before it }" << CONSOLEDEFAULT
+              << std::endl;
+    const vector<char> ends = fail({{}, blamed});
+    if (ends[0]) {
+      std::cout << FAILEDSTATUS << "\t" << settings.bisect
+                << ": fails when it runs alone" << std::endl;
+      return true;
+    }
+    if (!ends[1]) {
+      std::cout << PASSEDSTATUS << "\t" << settings.bisect
+                << ": passes after the tests before it" << std::endl;
+      return false;
+    }
+
+    std::size_t parts = 2;
+    while (blamed.size() > 1) {
+      std::cout << RUNNINGSTATUS << "\t" << blamed.size()
+                << " test(s) left to blame" << std::endl;
+      parts = std::min(parts, blamed.size());
+      // the parts first, then what is left without each of them
+      vector<vector<std::size_t>> candidates(parts);
+      for (std::size_t i = 0; i < blamed.size(); ++i) {
+        candidates[i * parts / blamed.size()].push_back(blamed[i]);
+      }
+      for (std::size_t p = 0; p < parts && parts > 2; ++p) {
+        candidates.emplace_back();
+        for (std::size_t i = 0; i < blamed.size(); ++i) {
+          if (i * parts / blamed.size() != p) {
+            candidates.back().push_back(blamed[i]);
+          }
+        }
+      }
+      const vector<char> failed = fail(candidates);
+      std::cout << CONSOLECLEARLASTLINE;
+      const auto first = std::find(failed.begin(), failed.end(), 1);
+      if (first != failed.end()) {
+        const std::size_t c = first - failed.begin();
+        blamed = candidates[c];
+        parts = c < parts ? 2 : std::max<std::size_t>(parts - 1, 2);
+      } else if (parts < blamed.size()) {
+        parts = std::min(parts * 2, blamed.size());
+      } else {
+        break;
+      }
+    }
+
+    std::cout << FAILEDSTATUS << "\t" << settings.bisect << ": fails after "
+              << blamed.size() << " of the " << at << " test(s) before it"
+              << std::endl;
+    for (std::size_t i : blamed) {
+      std::cout << "\t\t" << *order[i].env << "." << order[i].t->t_name
+                << std::endl;
+    }
+    std::cout << "\t\treplay with " << replay(blamed)
+              << (seed ? " --shuffle --seed=" + std::to_string(seed) : "")
+              << std::endl
+              << std::endl;
+    return true;
+  }
+
+  // runs the selected benchmarks once in every fresh process and replaces
+  // their tables with the spread of the results across those processes
+  static void rerunAllBenchmarks() {
+    auto &settings = internal::settings();
+    vector<string> arguments = internal::rerunArguments();
+    arguments.push_back("--benchmarks-only");
+    arguments.push_back("--benchmark-records");
+
+    using key = std::pair<string, string>;
+    map<key, string> columns;
+    map<key, vector<std::pair<string, vector<double>>>> rows;
+    map<key, std::pair<string, unsigned>> failed;
+
+    for (std::size_t i = 0; i < settings.benchprocesses; ++i) {
+      std::cout << RUNNINGSTATUS << "\tprocess " << i + 1 << "/"
+                << settings.benchprocesses << std::endl;
+      std::istringstream output(internal::runSelf(arguments));
+      std::cout << CONSOLECLEARLASTLINE;
+
+      string line;
+      while (std::getline(output, line)) {
+        vector<string> fields;
+        std::istringstream in(line);
+        string field;
+        while (std::getline(in, field, '\t')) {
+          fields.push_back(field);
+        }
+        if (fields.size() == 5 && fields[0] == "JBENCHFAILED") {
+          failed[{fields[1], fields[2]}] = {
+              fields[3], std::strtoul(fields[4].c_str(), nullptr, 10)};
+        } else if (fields.size() == 6 && fields[0] == "JBENCHRECORD") {
+          const key k{fields[1], fields[2]};
+          columns[k] = fields[3];
+          auto &r = rows[k];
+          auto row = std::find_if(r.begin(), r.end(), [&](auto &p) {
+            return p.first == fields[4];
+          });
+          if (row == r.end()) {
+            r.emplace_back(fields[4], vector<double>{});
+            row = r.end() - 1;
+          }
+          row->second.push_back(std::strtod(fields[5].c_str(), nullptr));
+        }
+      }
+    }
+
+    for (auto &p_envbenchlist : getInstance()._benches) {
+      for (auto &b : p_envbenchlist.second) {
+        const key k{p_envbenchlist.first, b.b_name};
+        if (!internal::selected(k.first, k.second)) {
+          continue;
+        }
+        b.b_done = true;
+        if (failed.count(k)) {
+          b.b_flawed = failed[k].first == "flawed";
+          b.b_ctx.failures = failed[k].second;
+        } else if (rows.count(k)) {
+          internal::aggregate(b, columns[k], rows[k], settings.benchprocesses);
+        } else {
+          b.b_flawed = true;
+        }
+      }
+    }
+  }
+#endif
+
+  TestRegister() = default;
+  TestRegister(void *){};
+
+  static TestRegister &getInstance() {
+    static TestRegister t{};
+    return t;
+  }
+
+  map<string, list<internal::test>> _tests;
+  map<string, list<internal::bench>> _benches;
+};
+
+#ifdef JTEST_POSIX
+// EXPECT_EXIT predicate: the child exited normally with this code
+inline internal::exitpredicate exitedWith(int code) {
+  return {[code](int status) {
+            return WIFEXITED(status) && WEXITSTATUS(status) == code;
+          },
+          "exit code " + std::to_string(code)};
+}
+
+// EXPECT_EXIT predicate: the child was killed by this signal
+inline internal::exitpredicate killedBy(int signal) {
+  return {[signal](int status) {
+            return WIFSIGNALED(status) && WTERMSIG(status) == signal;
+          },
+          "death by " + internal::signalName(signal)};
+}
+#endif
+
+// the test running on the calling thread, lets helper functions and threads
+// record expectations: JTest::internal::test &t = JTest::currentTest();
+inline internal::test &currentTest() { return *internal::test::current(); }
+
+// a clock for tests of timeouts, retries and expiry: time only moves when
+// every thread of the test is blocked in one of its waits (or joining a
+// JTest::thread), then it jumps straight to the next deadline. Put one in the
+// environment and hand it to the code under test instead of a real clock:
+// JTESTENV(CACHE) { JTest::virtualclock clock; };
+// Only the thread that constructs it and JTest::threads are tracked, a thread
+// blocked in anything else counts as running and holds time still.
+class virtualclock {
+public:
+  using duration = std::chrono::nanoseconds;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<virtualclock, duration>;
+  static constexpr bool is_steady = true;
+
+  virtualclock() {
+    if (internal::test::current()) {
+      internal::test::current()->t_clock = this;
+    }
+  }
+
+  ~virtualclock() {
+    if (internal::test::current() &&
+        internal::test::current()->t_clock == this) {
+      internal::test::current()->t_clock = nullptr;
+    }
+  }
+
+  virtualclock(const virtualclock &) = delete;
+  virtualclock &operator=(const virtualclock &) = delete;
+
+  time_point now() const {
+    std::lock_guard<std::mutex> lock(_lock);
+    return _now;
+  }
+
+  void sleepFor(duration d) { sleepUntil(now() + d); }
+
+  void sleepUntil(time_point deadline) {
+    waitUntil(deadline, [] { return false; });
+  }
+
+  // blocks until pred() holds or the deadline passed, pred is checked again
+  // after every notify(), returns the last result of pred()
+  template <class PRED> bool waitFor(duration d, PRED pred) {
+    return waitUntil(now() + d, std::move(pred));
+  }
+
+  template <class PRED> bool waitUntil(time_point deadline, PRED pred) {
+    while (!pred()) {
+      if (park(deadline)) {
+        return pred();
+      }
+    }
+    return true;
+  }
+
+  // wakes the waitFor/waitUntil callers to check their predicates again
+  void notify() {
+    std::lock_guard<std::mutex> lock(_lock);
+    for (auto e = _timers.begin(); e != _timers.end();) {
+      if (e->second.waiting) {
+        e->second.waiting->woken = true;
+        ++_awake;
+        e = _timers.erase(e);
+      } else {
+        ++e;
+      }
+    }
+    _wake.notify_all();
+  }
+
+  // runs callback once time reached now() + d, on whichever thread blocked
+  // last, so it must not block itself. Returns an id for cancel().
+  unsigned after(duration d, std::function<void()> callback) {
+    std::lock_guard<std::mutex> lock(_lock);
+    _timers.emplace(_now + d, timer{nullptr, std::move(callback), ++_lastId});
+    return _lastId;
+  }
+
+  // false if the callback already ran or was cancelled
+  bool cancel(unsigned id) {
+    std::lock_guard<std::mutex> lock(_lock);
+    for (auto e = _timers.begin(); e != _timers.end(); ++e) {
+      if (e->second.id == id) {
+        _timers.erase(e);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // the clock of the running test, if its environment has one
+  static virtualclock *active() {
+    return internal::test::current() ? internal::test::current()->t_clock
+                                     : nullptr;
+  }
+
+private:
+  friend class thread;
+
+  struct sleeper {
+    bool woken = false;
+    bool expired = false;
+  };
+
+  struct timer {
+    sleeper *waiting;
+    std::function<void()> callback;
+    unsigned id;
+  };
+
+  // a JTest::thread started under this clock
+  struct participant {
+    bool finished = false;
+    bool joining = false;
+  };
+
+  // true once the deadline passed, false if notify() woke the caller
+  bool park(time_point deadline) {
+    std::unique_lock<std::mutex> lock(_lock);
+    if (deadline <= _now) {
+      return true;
+    }
+    sleeper self;
+    _timers.emplace(deadline, timer{&self, nullptr, 0});
+    --_awake;
+    advance(lock);
+    _wake.wait(lock, [&] { return self.woken; });
+    return self.expired;
+  }
+
+  // while nobody can run, moves time to the next deadline and wakes whoever
+  // waits for it, one deadline at a time in the order they were set
+  void advance(std::unique_lock<std::mutex> &lock) {
+    while (_awake == 0 && !_timers.empty()) {
+      auto next = _timers.begin();
+      _now = std::max(_now, next->first);
+      timer due = std::move(next->second);
+      _timers.erase(next);
+      ++_awake;
+      if (due.waiting) {
+        due.waiting->woken = due.waiting->expired = true;
+      } else {
+        lock.unlock();
+        due.callback();
+        lock.lock();
+        --_awake;
+      }
+    }
+    _wake.notify_all();
+  }
+
+  std::shared_ptr<participant> spawn() {
+    std::lock_guard<std::mutex> lock(_lock);
+    ++_awake;
+    return std::make_shared<participant>();
+  }
+
+  // the joining thread becomes runnable in the same step, so time can't jump
+  // in between
+  void exit(participant &p) {
+    std::unique_lock<std::mutex> lock(_lock);
+    p.finished = true;
+    if (!p.joining) {
+      --_awake;
+    }
+    advance(lock);
+  }
+
+  void join(participant &p) {
+    std::unique_lock<std::mutex> lock(_lock);
+    if (p.finished) {
+      return;
+    }
+    p.joining = true;
+    --_awake;
+    advance(lock);
+    _wake.wait(lock, [&] { return p.finished; });
+  }
+
+  mutable std::mutex _lock;
+  std::condition_variable _wake;
+  time_point _now{};
+  // threads that are not blocked in one of the waits above
+  unsigned _awake = 1;
+  unsigned _lastId = 0;
+  std::multimap<time_point, timer> _timers;
+};
+
+// a std::thread that runs with the test context of the thread that created
+// it, so EXPECT_* inside it count towards that test. It joins when it goes out
+// of scope, a test has to outlive every thread that records expectations.
+class thread {
+public:
+  template <class F, class... ARGS>
+  explicit thread(F &&f, ARGS &&...args)
+      : _clock(virtualclock::active()),
+        _participant(_clock ? _clock->spawn() : nullptr),
+        _thread(
+            [](internal::test *context, internal::capture *output,
+               virtualclock *clock,
+               std::shared_ptr<virtualclock::participant> participant,
+               typename std::decay<F>::type func,
+               typename std::decay<ARGS>::type... params) {
+              internal::test::current() = context;
+              internal::capture::current() = output;
+              func(std::move(params)...);
+              if (clock) {
+                clock->exit(*participant);
+              }
+            },
+            internal::test::current(), internal::capture::current(), _clock,
+            _participant,
+            std::forward<F>(f), std::forward<ARGS>(args)...) {}
+
+  thread(thread &&) = default;
+  thread &operator=(thread &&other) {
+    if (_thread.joinable()) {
+      join();
+    }
+    _clock = other._clock;
+    _participant = std::move(other._participant);
+    _thread = std::move(other._thread);
+    return *this;
+  }
+
+  ~thread() {
+    if (_thread.joinable()) {
+      join();
+    }
+  }
+
+  void join() {
+    if (_clock && _participant) {
+      _clock->join(*_participant);
+    }
+    _thread.join();
+  }
+  bool joinable() const { return _thread.joinable(); }
+  std::thread::id get_id() const { return _thread.get_id(); }
+
+private:
+  virtualclock *_clock;
+  std::shared_ptr<virtualclock::participant> _participant;
+  std::thread _thread;
+};
+
+// records invocations and responses of operations on a concurrent object from
+// any number of threads. MODEL is the sequential specification of the object:
+// a copyable and equality comparable state with the member types operation and
+// result and a member function result apply(const operation &) that performs
+// the operation. Operations and results need an operator<< for printing.
+template <class MODEL> class history {
+public:
+  using operation = typename MODEL::operation;
+  using result = typename MODEL::result;
+
+  struct event {
+    operation op;
+    result res;
+    // logical timestamps, every invocation and response gets a unique one in
+    // the order they happened in
+    std::uint64_t invoked;
+    std::uint64_t responded;
+    std::size_t thread;
+  };
+
+  history() = default;
+  history(const history &) = delete;
+
+  // records the invocation of op, runs action and records its return value as
+  // the response
+  template <class F> result record(const operation &op, F &&action) {
+    event &e = invoke(op);
+    result res = action();
+    respond(e, res);
+    return res;
+  }
+
+  event &invoke(const operation &op) {
+    auto &log = threadLog();
+    log.events.push_back(
+        event{op, result{}, _clock.fetch_add(1), 0, log.thread});
+    return log.events.back();
+  }
+
+  void respond(event &e, const result &res) {
+    e.res = res;
+    e.responded = _clock.fetch_add(1);
+  }
+
+  // every completed operation of every thread, the threads have to be joined
+  vector<event> events() const {
+    std::lock_guard<std::mutex> guard{_lock};
+    vector<event> all;
+    for (auto &log : _logs) {
+      for (auto &e : log.events) {
+        if (e.responded) {
+          all.push_back(e);
+        }
+      }
+    }
+    return all;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> guard{_lock};
+    _logs.clear();
+    _id = internal::test::nextId();
+  }
+
+private:
+  struct threadlog {
+    std::size_t thread;
+    std::deque<event> events;
+  };
+
+  // each thread appends to its own log, only its first event takes the lock
+  threadlog &threadLog() {
+    thread_local std::uint64_t cachedid = 0;
+    thread_local threadlog *cached = nullptr;
+    if (cachedid != _id) {
+      std::lock_guard<std::mutex> guard{_lock};
+      _logs.push_back(threadlog{_logs.size(), {}});
+      cached = &_logs.back();
+      cachedid = _id;
+    }
+    return *cached;
+  }
+
+  std::atomic<std::uint64_t> _clock{1};
+  std::uint64_t _id = internal::test::nextId();
+  mutable std::mutex _lock;
+  list<threadlog> _logs;
+};
+
+namespace internal {
+
+// Wing & Gong's search for a linearization, with Lowe's memoization of the
+// (linearized operations, model state) pairs that were already explored
+template <class MODEL, class EVENT>
+bool linearize(const vector<EVENT> &events, const MODEL &initial) {
+  const std::size_t n = events.size();
+  // the invocations and responses as one doubly linked list in time order,
+  // node 0 is the head, node 1 + 2i is the invocation of event i and
+  // node 2 + 2i its response
+  vector<std::pair<std::uint64_t, std::size_t>> order;
+  for (std::size_t i = 0; i < n; ++i) {
+    order.emplace_back(events[i].invoked, 1 + 2 * i);
+    order.emplace_back(events[i].responded, 2 + 2 * i);
+  }
+  std::sort(order.begin(), order.end());
+  vector<std::size_t> next(2 * n + 1, 0), prev(2 * n + 1, 0);
+  std::size_t last = 0;
+  for (auto &o : order) {
+    next[last] = o.second;
+    prev[o.second] = last;
+    last = o.second;
+  }
+  next[last] = 0;
+
+  auto unlink = [&](std::size_t node) {
+    next[prev[node]] = next[node];
+    if (next[node]) {
+      prev[next[node]] = prev[node];
+    }
+  };
+  auto relink = [&](std::size_t node) {
+    next[prev[node]] = node;
+    if (next[node]) {
+      prev[next[node]] = node;
+    }
+  };
+
+  vector<std::uint64_t> linearized((n + 63) / 64, 0);
+  std::map<vector<std::uint64_t>, vector<MODEL>> seen;
+  vector<std::pair<std::size_t, MODEL>> calls;
+  MODEL state = initial;
+
+  std::size_t node = next[0];
+  while (next[0]) {
+    if (node && node % 2) {
+      const std::size_t i = (node - 1) / 2;
+      MODEL after = state;
+      bool explored = true;
+      if (after.apply(events[i].op) == events[i].res) {
+        linearized[i / 64] |= std::uint64_t{1} << (i % 64);
+        auto &states = seen[linearized];
+        if (std::find(states.begin(), states.end(), after) == states.end()) {
+          states.push_back(after);
+          explored = false;
+        } else {
+          linearized[i / 64] &= ~(std::uint64_t{1} << (i % 64));
+        }
+      }
+      if (!explored) {
+        calls.emplace_back(node, state);
+        state = std::move(after);
+        unlink(node);
+        unlink(node + 1);
+        node = next[0];
+      } else {
+        node = next[node];
+      }
+    } else {
+      // a response was reached before its invocation could be linearized,
+      // undo the most recent choice and try the next invocation after it
+      if (calls.empty()) {
+        return false;
+      }
+      node = calls.back().first;
+      state = std::move(calls.back().second);
+      calls.pop_back();
+      const std::size_t i = (node - 1) / 2;
+      linearized[i / 64] &= ~(std::uint64_t{1} << (i % 64));
+      relink(node + 1);
+      relink(node);
+      node = next[node];
+    }
+  }
+  return true;
+}
+
+} // namespace internal
+
+// whether the recorded history has a linearization that the model accepts,
+// if not the shortest failing prefix of it is written to why
+template <class MODEL>
+bool linearizable(const history<MODEL> &recorded, const MODEL &initial,
+                  std::ostream *why = nullptr) {
+  auto events = recorded.events();
+  if (internal::linearize(events, initial)) {
+    return true;
+  }
+
+  // the shortest prefix (in invocation order) that still fails. Dropping
+  // arbitrary operations would leave the results of later ones unexplained, a
+  // prefix keeps everything that could have caused them: grow it by doubling
+  // and then find the first failing length below that
+  std::sort(events.begin(), events.end(),
+            [](auto &a, auto &b) { return a.invoked < b.invoked; });
+  auto fails = [&](std::size_t length) {
+    return !internal::linearize(
+        decltype(events)(events.begin(), events.begin() + length), initial);
+  };
+  std::size_t length = 1;
+  while (length < events.size() && !fails(length)) {
+    length *= 2;
+  }
+  length = std::min(length, events.size());
+  for (std::size_t shorter = length / 2 + 1; shorter < length; ++shorter) {
+    if (fails(shorter)) {
+      length = shorter;
+      break;
+    }
+  }
+  const std::size_t total = events.size();
+  events.resize(length);
+
+  if (why) {
+    *why << "history of " << total << " operation(s) is not linearizable, "
+         << "the first " << length << " already fail:";
+    for (auto &e : events) {
+      *why << "\n  thread " << e.thread << "  [" << e.invoked << ", "
+           << e.responded << "]  " << e.op << " -> " << e.res;
+    }
+  }
+  return false;
+}
+
+namespace explore {
+
+// a scheduling point under JTEST_EXPLORE, does nothing anywhere else
+inline void yield() {
+  if (internal::scheduler *s = internal::scheduler::active()) {
+    s->yieldPoint();
+  }
+}
+
+// a std::atomic whose every operation is a scheduling point under
+// JTEST_EXPLORE, everything is sequentially consistent
+template <class T> class atomic {
+public:
+  atomic() = default;
+  atomic(T desired) : _value(desired) {}
+  atomic(const atomic &) = delete;
+
+  T load() const {
+    yield();
+    return _value.load();
+  }
+  void store(T desired) {
+    yield();
+    _value.store(desired);
+  }
+  T exchange(T desired) {
+    yield();
+    return _value.exchange(desired);
+  }
+  bool compare_exchange_strong(T &expected, T desired) {
+    yield();
+    return _value.compare_exchange_strong(expected, desired);
+  }
+  bool compare_exchange_weak(T &expected, T desired) {
+    return compare_exchange_strong(expected, desired);
+  }
+  T fetch_add(T arg) {
+    yield();
+    return _value.fetch_add(arg);
+  }
+  T fetch_sub(T arg) {
+    yield();
+    return _value.fetch_sub(arg);
+  }
+
+  operator T() const { return load(); }
+  T operator=(T desired) {
+    store(desired);
+    return desired;
+  }
+  T operator++() { return fetch_add(1) + 1; }
+  T operator--() { return fetch_sub(1) - 1; }
+  T operator++(int) { return fetch_add(1); }
+  T operator--(int) { return fetch_sub(1); }
+
+private:
+  std::atomic<T> _value;
+};
+
+// a mutex the scheduler of JTEST_EXPLORE knows about, a thread waiting for it
+// isn't chosen until it is unlocked. Outside of JTEST_EXPLORE it is a
+// std::mutex.
+class mutex {
+public:
+  void lock() {
+    if (internal::scheduler *s = internal::scheduler::active()) {
+      s->lock(_owner);
+    } else {
+      _mutex.lock();
+    }
+  }
+  bool try_lock() {
+    if (internal::scheduler *s = internal::scheduler::active()) {
+      return s->tryLock(_owner);
+    }
+    return _mutex.try_lock();
+  }
+  void unlock() {
+    if (internal::scheduler *s = internal::scheduler::active()) {
+      s->unlock(_owner);
+    } else {
+      _mutex.unlock();
+    }
+  }
+
+private:
+  std::size_t _owner = internal::scheduler::none;
+  std::mutex _mutex;
+};
+
+// a JTest::thread that is managed by the scheduler of JTEST_EXPLORE, it only
+// runs when it is chosen. Outside of JTEST_EXPLORE it is a JTest::thread.
+class thread {
+public:
+  template <class F> explicit thread(F &&f) : _scheduler(nullptr) {
+    _scheduler = internal::scheduler::active();
+    internal::test *context = internal::test::current();
+    internal::capture *output = internal::capture::current();
+    if (!_scheduler) {
+      _thread = std::thread([context, output, f]() mutable {
+        internal::test::current() = context;
+        internal::capture::current() = output;
+        f();
+      });
+      return;
+    }
+    _id = _scheduler->spawn();
+    internal::scheduler *s = _scheduler;
+    const std::size_t id = _id;
+    _thread = std::thread([s, id, context, output, f]() mutable {
+      internal::test::current() = context;
+      internal::capture::current() = output;
+      if (s->start(id)) {
+        JTEST_TRY {
+          f();
+        } JTEST_CATCH(internal::explorationaborted &) {
+        } JTEST_CATCH(...) {
+          s->fail(std::current_exception());
+        }
+      }
+      s->finish();
+    });
+    _scheduler->yieldPoint();
+  }
+
+  thread(thread &&other) = default;
+
+  ~thread() {
+    if (_thread.joinable()) {
+      JTEST_TRY {
+        join();
+      } JTEST_CATCH(internal::explorationaborted &) {
+        _thread.join();
+      }
+    }
+  }
+
+  void join() {
+    if (_scheduler) {
+      _scheduler->join(_id);
+    }
+    _thread.join();
+  }
+
+private:
+  internal::scheduler *_scheduler;
+  std::size_t _id = 0;
+  std::thread _thread;
+};
+
+} // namespace explore
+
+namespace internal {
+
+// runs a JTEST_EXPLORE body under one schedule after the other: first a depth
+// first search over the schedules with at most --explore-preemptions
+// preemptions, if that doesn't finish in half of --explore-runs the other half
+// picks schedules at random. Stops at the first failing schedule and notes it.
+template <class SUITE>
+void explore(test &t, void (SUITE::*body)(test &)) {
+  auto &o = settings();
+  vector<std::size_t> forced = o.explorereplay;
+  const bool replaying = !forced.empty();
+  const std::uint64_t seed =
+      o.exploreseed ? o.exploreseed : std::random_device{}();
+  const std::size_t runs =
+      replaying ? 1 : std::max<std::size_t>(1, o.exploreruns);
+  bool random = false;
+
+  for (std::size_t run = 0; run < runs; ++run) {
+    scheduler s{forced, random, seed + run};
+    test attempt{string(t.t_name), nullptr};
+    std::exception_ptr thrown;
+    {
+      SUITE suite{};
+      suite.setup();
+      thrown = s.run(attempt, [&](test &inner) { (suite.*body)(inner); });
+      suite.teardown();
+    }
+
+    if (thrown || attempt.failures || s.aborted()) {
+      for (unsigned i = 0; i < attempt.failures; ++i) {
+        t.incr();
+      }
+      for (auto &n : attempt.t_notes) {
+        t.note(n);
+      }
+      std::ostringstream why;
+      if (s.aborted()) {
+        why << s.reason() << ", ";
+        if (!thrown) {
+          t.incr();
+        }
+      }
+      why << "failing schedule (run " << run + 1;
+      if (random) {
+        why << ", random seed " << seed;
+      }
+      why << "):\n  --explore-replay=" << s.schedule();
+      t.note(why.str());
+      if (thrown) {
+        std::rethrow_exception(thrown);
+      }
+      return;
+    }
+
+    if (!random && !s.backtrack(forced, o.explorepreemptions)) {
+      return;
+    }
+    if (!random && run + 1 >= runs / 2) {
+      random = true;
+      forced.clear();
+    }
+  }
+}
+
+} // namespace internal
+
+// keeps the compiler from optimizing away a value computed in a benchmark body
+template <class T> inline void doNotOptimize(const T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static volatile const void *sink;
+  sink = &value;
+#endif
+}
+
+inline int RunAllTests() { return TestRegister::runAllTests(); };
+
+inline int RunAllTests(int argc, char *argv[]) {
+  internal::settings().parse(argc, argv);
+  return TestRegister::runAllTests();
+};
 
 } // namespace JTest
 
@@ -0,0 +1,36 @@
+#include "../JTest.h"
+
+#ifdef JTEST_COROUTINES
+#include <unistd.h>
+
+JTESTENV(ASYNC) {
+  SETUP { (void)pipe(fds); };
+  TEARDOWN {
+    close(fds[0]);
+    close(fds[1]);
+  };
+
+protected:
+  int fds[2] = {-1, -1};
+};
+
+JTest::task<int> delayed(int value) {
+  co_await JTest::sleepFor(std::chrono::milliseconds(100));
+  co_return value;
+}
+
+JTEST_ASYNC(ASYNC, asyncpass) {
+  co_await JTest::sleepFor(std::chrono::milliseconds(50));
+  EXPECT_EQ(write(fds[1], "x", 1), 1);
+  co_await JTest::readable(fds[0]);
+  char c = 0;
+  EXPECT_EQ(read(fds[0], &c, 1), 1);
+  const int value = co_await delayed(42);
+  EXPECT_EQ(value, 42);
+}
+
+JTEST_ASYNC(ASYNC, asyncfail) {
+  const int value = co_await delayed(1);
+  EXPECT_EQ(value, 2);
+}
+#endif
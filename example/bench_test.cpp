@@ -0,0 +1,25 @@
+#include "../JTest.h"
+
+#include <atomic>
+#include <mutex>
+
+JTESTENV(COUNTER) {
+  SETUP {
+    shared = 0;
+    locked = 0;
+  };
+
+protected:
+  std::atomic<long> shared;
+  std::mutex lock;
+  long locked;
+};
+
+JBENCH(COUNTER, relaxed) {
+  shared.fetch_add(1, std::memory_order_relaxed);
+}
+
+JBENCH_THREADS(COUNTER, mutex, 1, 4) {
+  std::lock_guard<std::mutex> guard{lock};
+  JTest::doNotOptimize(++locked);
+}
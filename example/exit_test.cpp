@@ -0,0 +1,34 @@
+#include "../JTest.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+JTESTENV(EXIT) {
+protected:
+  // reports a broken invariant the way code built without exceptions does
+  static void check(bool invariant) {
+    if (!invariant) {
+      std::fputs("invariant broken\n", stderr);
+      std::abort();
+    }
+  }
+
+  // complains the way a command line tool does
+  static void usage() {
+    std::cerr << "usage: tool FILE" << std::endl;
+    std::exit(2);
+  }
+};
+
+JTEST(EXIT, exitpass) {
+  EXPECT_ABORT(check(false));
+  EXPECT_EXIT(check(false), JTest::killedBy(SIGABRT), "*invariant broken*");
+  EXPECT_EXIT(std::exit(3), JTest::exitedWith(3));
+  EXPECT_EXIT(usage(), JTest::exitedWith(2), "usage: tool*");
+}
+
+JTEST(EXIT, exitfail) {
+  EXPECT_ABORT(check(true));
+  EXPECT_EXIT(std::exit(3), JTest::exitedWith(0));
+}
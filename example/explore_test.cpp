@@ -0,0 +1,71 @@
+#include "../JTest.h"
+
+#include <iostream>
+
+JTESTENV(EXPLORE) {
+  SETUP {
+    balance = 100;
+    guarded = 100;
+  };
+  TEARDOWN{};
+
+public:
+  // checks and withdraws in two steps, two threads can both pass the check
+  void withdraw(int amount) {
+    if (balance.load() >= amount) {
+      balance.fetch_sub(amount);
+    }
+  }
+
+  void withdrawGuarded(int amount) {
+    lock.lock();
+    if (guarded.load() >= amount) {
+      guarded.fetch_sub(amount);
+    }
+    lock.unlock();
+  }
+
+  JTest::explore::atomic<int> balance;
+  JTest::explore::atomic<int> guarded;
+  JTest::explore::mutex lock;
+};
+
+JTEST_EXPLORE(EXPLORE, explorepass) {
+  {
+    JTest::explore::thread first([&] { withdrawGuarded(80); });
+    JTest::explore::thread second([&] { withdrawGuarded(80); });
+  }
+  EXPECT_TRUE(guarded.load() >= 0);
+}
+
+JTEST_EXPLORE(EXPLORE, explorefail) {
+  {
+    JTest::explore::thread first([&] { withdraw(80); });
+    JTest::explore::thread second([&] { withdraw(80); });
+  }
+  EXPECT_TRUE(balance.load() >= 0);
+}
+
+JTEST_EXPLORE(EXPLORE, exploredeadlock) {
+  JTest::explore::mutex a, b;
+  JTest::explore::thread first([&] {
+    a.lock();
+    b.lock();
+    b.unlock();
+    a.unlock();
+  });
+  JTest::explore::thread second([&] {
+    b.lock();
+    a.lock();
+    a.unlock();
+    b.unlock();
+  });
+}
+
+JTEST_EXPLORE(EXPLORE, exploreoutput) {
+  {
+    JTest::explore::thread first(
+        [&] { std::cout << "written by an explore thread" << std::endl; });
+  }
+  EXPECT_TRUE(false);
+}
@@ -0,0 +1,69 @@
+#include "../JTest.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+JTESTENV(COUNTERS) {
+  SETUP {
+    racy = 0;
+    safe = 0;
+  };
+  TEARDOWN{};
+
+public:
+  // the sequential specification: increment returns the previous value
+  struct model {
+    using operation = std::string;
+    using result = int;
+
+    int apply(const operation &) { return value++; }
+    bool operator==(const model &other) const { return value == other.value; }
+
+    int value = 0;
+  };
+
+  int safeIncrement() { return safe.fetch_add(1); }
+
+  // reading and writing are separate steps, concurrent calls can return the
+  // same value
+  int racyIncrement() {
+    const int seen = racy.load();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    racy.store(seen + 1);
+    return seen;
+  }
+
+  std::atomic<int> racy, safe;
+  JTest::history<model> events;
+};
+
+JTEST(COUNTERS, linearizablepass) {
+  {
+    std::vector<JTest::thread> pool;
+    for (int i = 0; i < 4; ++i) {
+      pool.emplace_back([&] {
+        for (int j = 0; j < 50; ++j) {
+          events.record("increment", [&] { return safeIncrement(); });
+        }
+      });
+    }
+  }
+  EXPECT_LINEARIZABLE(events, model{});
+}
+
+JTEST(COUNTERS, linearizablefail) {
+  {
+    std::vector<JTest::thread> pool;
+    for (int i = 0; i < 4; ++i) {
+      pool.emplace_back([&] {
+        for (int j = 0; j < 5; ++j) {
+          events.record("increment", [&] { return racyIncrement(); });
+        }
+      });
+    }
+  }
+  EXPECT_LINEARIZABLE(events, model{});
+}
@@ -0,0 +1,21 @@
+#include "../JTest.h"
+
+#include <map>
+
+JTESTENV(LOAD) {
+  SETUP {
+    for (int i = 0; i < 1000; ++i) {
+      table[i] = i * i;
+    }
+  };
+  TEARDOWN { table.clear(); };
+
+protected:
+  std::map<int, int> table;
+  int next = 0;
+};
+
+JLOAD(LOAD, lookup, 2000) {
+  EXPECT_EQ(table[next % 1000], (next % 1000) * (next % 1000));
+  ++next;
+}
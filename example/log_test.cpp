@@ -0,0 +1,24 @@
+#include "../JTest.h"
+
+#include <string>
+
+JTESTENV(LOG) {
+protected:
+  // pretends to reach a server, fails until the given attempt
+  static bool connect(int attempt, int works) { return attempt >= works; }
+};
+
+JTEST(LOG, logpass) {
+  for (int attempt = 1; !connect(attempt, 3); ++attempt) {
+    JTEST_LOG("attempt ", attempt, " failed, retrying");
+  }
+}
+
+JTEST(LOG, logfail) {
+  const std::string server = "db-" + std::to_string(7);
+  int attempt = 1;
+  for (; attempt <= 3 && !connect(attempt, 5); ++attempt) {
+    JTEST_LOG("attempt ", attempt, " to ", server, " failed");
+  }
+  EXPECT_TRUE(attempt <= 3);
+}
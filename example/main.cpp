@@ -1,3 +1,3 @@
 #include "../JTest.h"
 
-int main(int argc, char *argv[]) { return JTest::RunAllTests(); }
+int main(int argc, char *argv[]) { return JTest::RunAllTests(argc, argv); }
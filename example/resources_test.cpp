@@ -0,0 +1,30 @@
+#include "../JTest.h"
+
+#include <string>
+
+// the tests share a global, with --jobs they still take turns
+JTESTENV_SERIAL(SINGLETON) {
+protected:
+  static std::string &config() {
+    static std::string value;
+    return value;
+  }
+};
+
+JTEST(SINGLETON, singletonfirst) {
+  config() = "first";
+  EXPECT_EQ(config(), std::string("first"));
+}
+
+JTEST(SINGLETON, singletonsecond) {
+  config() = "second";
+  EXPECT_EQ(config(), std::string("second"));
+}
+
+JTESTENV(PORTS) {};
+
+JTEST_RESOURCES(PORTS, listen, JTest::exclusive("port 8080"));
+JTEST(PORTS, listen) { EXPECT_EQ(8080, 8080); }
+
+JTEST_RESOURCES(PORTS, connect, JTest::shared("port 8080", 4));
+JTEST(PORTS, connect) { EXPECT_EQ(8080, 8080); }
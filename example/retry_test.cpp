@@ -0,0 +1,10 @@
+#include "../JTest.h"
+
+JTESTENV(RETRY){};
+
+// fails in the run itself and passes when --retries reruns it on its own
+JTEST(RETRY, retryflaky) {
+  EXPECT_TRUE(JTest::internal::settings().testrecords);
+}
+
+JTEST(RETRY, retryfail) { EXPECT_EQ(1, 2); }
@@ -0,0 +1,23 @@
+#include "../JTest.h"
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+JTESTENV(SEQUENCE) {
+  SETUP {
+    values.resize(benchSize());
+    std::iota(values.rbegin(), values.rend(), 0);
+  };
+
+protected:
+  std::vector<int> values;
+};
+
+JBENCH_SIZES(SEQUENCE, sum, 1 << 10, 1 << 14) {
+  JTest::doNotOptimize(std::accumulate(values.begin(), values.end(), 0));
+}
+
+JBENCH_COMPLEXITY(SEQUENCE, find, 1 << 10, 1 << 14, on) {
+  JTest::doNotOptimize(std::find(values.begin(), values.end(), -1));
+}
@@ -0,0 +1,46 @@
+#include "../JTest.h"
+
+#include <atomic>
+#include <iostream>
+#include <mutex>
+
+JTESTENV(STRESS) {
+  SETUP { occupants = 0; };
+  TEARDOWN{};
+
+public:
+  // checking and taking the flag are two separate steps, two threads can both
+  // see it free, JTEST_YIELD_POINT() widens the gap between them
+  void brokenLock() {
+    while (taken.load()) {
+    }
+    JTEST_YIELD_POINT();
+    taken.store(true);
+  }
+  void brokenUnlock() { taken.store(false); }
+
+  std::atomic<bool> taken{false};
+  std::atomic<int> occupants;
+  std::mutex lock;
+};
+
+JTEST_STRESS(STRESS, stresspass, 4, 1000) {
+  std::lock_guard<std::mutex> guard{lock};
+  EXPECT_EQ(++occupants, 1);
+  JTEST_YIELD_POINT();
+  --occupants;
+}
+
+JTEST_STRESS(STRESS, stressfail, 4, 1000) {
+  brokenLock();
+  EXPECT_EQ(++occupants, 1);
+  JTEST_YIELD_POINT();
+  --occupants;
+  brokenUnlock();
+}
+
+// what the threads write is kept with the test, not sent to the terminal
+JTEST_STRESS(STRESS, stressoutput, 2, 1) {
+  std::cout << "written by a stress thread" << std::endl;
+  EXPECT_TRUE(false);
+}
@@ -0,0 +1,29 @@
+#include "../JTest.h"
+
+#include <vector>
+
+JTESTENV(THREADS) {
+  SETUP { workers = 4; };
+
+protected:
+  int workers;
+};
+
+JTEST(THREADS, threadspass) {
+  std::vector<JTest::thread> pool;
+  for (int i = 0; i < workers; ++i) {
+    pool.emplace_back([&, i] { EXPECT_TRUE(i < workers); });
+  }
+}
+
+JTEST(THREADS, threadsfail) {
+  std::vector<JTest::thread> pool;
+  for (int i = 0; i < workers; ++i) {
+    pool.emplace_back([i] {
+      JTest::internal::test &t = JTest::currentTest();
+      for (int j = 0; j < 1000; ++j) {
+        EXPECT_EQ(i, -1);
+      }
+    });
+  }
+}
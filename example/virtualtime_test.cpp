@@ -0,0 +1,45 @@
+#include "../JTest.h"
+
+#include <atomic>
+
+using namespace std::chrono_literals;
+
+JTESTENV(VIRTUALTIME) {
+protected:
+  JTest::virtualclock clock;
+
+  // calls attempt until it succeeds, waiting 1s, 2s, 4s, ... in between
+  template <class F> int retry(F attempt) {
+    int tries = 1;
+    for (auto backoff = 1s; !attempt(); backoff *= 2, ++tries) {
+      clock.sleepFor(backoff);
+    }
+    return tries;
+  }
+};
+
+JTEST(VIRTUALTIME, backoffpass) {
+  const auto start = clock.now();
+  int failures = 5;
+  EXPECT_EQ(retry([&] { return failures-- == 0; }), 6);
+  EXPECT_TRUE(clock.now() - start == 31s);
+}
+
+JTEST(VIRTUALTIME, timeoutpass) {
+  std::atomic<bool> ready{false};
+  JTest::thread producer([&] {
+    clock.sleepFor(10s);
+    ready = true;
+    clock.notify();
+  });
+  EXPECT_FALSE(clock.waitFor(5s, [&] { return ready.load(); }));
+  EXPECT_TRUE(clock.waitFor(60s, [&] { return ready.load(); }));
+  EXPECT_TRUE(clock.now().time_since_epoch() == 10s);
+}
+
+JTEST(VIRTUALTIME, expiryfail) {
+  bool expired = false;
+  clock.after(30s, [&] { expired = true; });
+  clock.sleepFor(29s);
+  EXPECT_TRUE(expired);
+}